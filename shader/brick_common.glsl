@@ -0,0 +1,13 @@
+// brick occupancy shared by the sparse grid kernels (see SparseGrid.hpp)
+
+const uint BRICK_OCCUPIED = 1u; // a particle is within FLUID_MARGIN cells this step
+const uint BRICK_WAS_OCCUPIED = 2u; // a particle was within FLUID_MARGIN cells last step
+const uint MAX_BRICK_GROUPS = 65535u; // per dispatch dimension
+
+layout(std430, binding=16) restrict buffer BrickStateBlock {
+    uint brick_state[]; // one per brick
+};
+
+uint num_bricks() {
+    return uint(brick_dim.x * brick_dim.y * brick_dim.z);
+}
@@ -0,0 +1,11 @@
+// size the indirect dispatch of grid kernels over the active bricks
+
+layout(local_size_x = 1) in;
+
+uniform uint tiles_per_brick;
+
+void main() {
+    brick_groups_x = tiles_per_brick;
+    brick_groups_y = min(num_active_bricks, MAX_BRICK_GROUPS);
+    brick_groups_z = (num_active_bricks + MAX_BRICK_GROUPS - 1u) / MAX_BRICK_GROUPS;
+}
@@ -0,0 +1,20 @@
+// append the bricks occupied this step or last step to active_brick
+//
+// A brick stays active for one step after its particles leave, so its cells
+// go through the pipeline once more without fluid and are left as the dense
+// grid would have them.
+
+layout(local_size_x = 256) in;
+
+void main() {
+    uint brick = gl_GlobalInvocationID.x;
+    if (brick >= num_bricks())
+        return;
+
+    uint state = brick_state[brick];
+    if (state != 0u) {
+        uvec3 coord = uvec3(brick % uint(brick_dim.x), (brick / uint(brick_dim.x)) % uint(brick_dim.y), brick / uint(brick_dim.x * brick_dim.y));
+        active_brick[atomicAdd(num_active_bricks, 1u)] = pack_brick_coord(coord);
+    }
+    brick_state[brick] = (state & BRICK_OCCUPIED) != 0u ? BRICK_WAS_OCCUPIED : 0u;
+}
@@ -0,0 +1,22 @@
+// mark the bricks within FLUID_MARGIN cells of each particle as occupied
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= particle_count()) {
+        return;
+    }
+
+    ivec3 cell = clamp(get_grid_coord(particle_pos(index), ivec3(0)), ivec3(0), grid_dim - ivec3(1));
+    ivec3 first = max(cell - ivec3(FLUID_MARGIN), ivec3(0)) / BRICK_SIZE;
+    ivec3 last = min(cell + ivec3(FLUID_MARGIN), grid_dim - ivec3(1)) / BRICK_SIZE;
+    for (int z = first.z; z <= last.z; ++z) {
+        for (int y = first.y; y <= last.y; ++y) {
+            for (int x = first.x; x <= last.x; ++x) {
+                uint brick = uint(z * brick_dim.y * brick_dim.x + y * brick_dim.x + x);
+                // most particles share their brick with many others, skip the atomic when it's already set
+                if ((brick_state[brick] & BRICK_OCCUPIED) == 0u)
+                    atomicOr(brick_state[brick], BRICK_OCCUPIED);
+            }
+        }
+    }
+}
@@ -0,0 +1,3 @@
+layout(std430, binding=7) restrict buffer ChebyshevBlock {
+    float chebyshev_previous[]; // pressure of the iteration before pressure_guess
+};
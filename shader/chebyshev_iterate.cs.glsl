@@ -0,0 +1,71 @@
+// Jacobi iteration with Chebyshev acceleration:
+// pressure = omega * (jacobi(pressure_guess) - previous) + previous
+
+uniform float omega;
+
+// pressure_guess and off-diagonal coefficients of the tile and its halo
+shared float tile_guess[TILE_HALO_SIZE];
+shared vec3 tile_a[TILE_HALO_SIZE];
+
+void main() {
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        tile_guess[i] = 0;
+        tile_a[i] = vec3(0);
+        if (in_grid(pos)) {
+            uint j = get_grid_index(pos);
+            tile_guess[i] = cell_pressure[j].pressure_guess;
+            tile_a[i] = vec3(cell_a[j].a_x, cell_a[j].a_y, cell_a[j].a_z);
+        }
+    }
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+    int t = tile_index(grid_pos);
+
+    if (cell_flags[index].type == AIR) {
+        cell_pressure[index].pressure = 0;
+        return;
+    }
+    if (cell_flags[index].type == SOLID) {
+        // invalid
+        cell_pressure[index].pressure = 0;
+        return;
+    }
+
+    float L_Up = 0;
+
+    if (grid_pos.x > 0) {
+        int j = tile_index(grid_pos + ivec3(-1, 0, 0));
+        L_Up += tile_a[j].x * tile_guess[j];
+    }
+    if (grid_pos.y > 0) {
+        int j = tile_index(grid_pos + ivec3(0, -1, 0));
+        L_Up += tile_a[j].y * tile_guess[j];
+    }
+    if (grid_pos.z > 0) {
+        int j = tile_index(grid_pos + ivec3(0, 0, -1));
+        L_Up += tile_a[j].z * tile_guess[j];
+    }
+
+    if (grid_pos.x < grid_dim.x - 2) {
+        int j = tile_index(grid_pos + ivec3(1, 0, 0));
+        L_Up += tile_a[t].x * tile_guess[j];
+    }
+    if (grid_pos.y < grid_dim.y - 2) {
+        int j = tile_index(grid_pos + ivec3(0, 1, 0));
+        L_Up += tile_a[t].y * tile_guess[j];
+    }
+    if (grid_pos.z < grid_dim.z - 2) {
+        int j = tile_index(grid_pos + ivec3(0, 0, 1));
+        L_Up += tile_a[t].z * tile_guess[j];
+    }
+
+    if (cell_a[index].a_diag != 0) {
+        float jacobi = 1.0 / cell_a[index].a_diag * (cell_pressure[index].rhs - L_Up);
+        cell_pressure[index].pressure = mix(chebyshev_previous[index], jacobi, omega);
+    }
+}
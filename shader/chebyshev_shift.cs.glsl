@@ -0,0 +1,11 @@
+// advance the Chebyshev iteration: previous = pressure_guess, pressure_guess = pressure
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    chebyshev_previous[index] = cell_pressure[index].pressure_guess;
+    cell_pressure[index].pressure_guess = cell_pressure[index].pressure;
+}
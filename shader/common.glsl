@@ -2,24 +2,44 @@ int AIR = 0;
 int SOLID = 1;
 int FLUID = 2;
 
+#ifdef COMPACT_PARTICLES
+// 20 bytes (see CompactParticle.hpp); use the particle_* accessors below
+struct Particle {
+    uint cell_palette; // grid index of the containing cell in the low 28 bits, palette index in the high 4
+    uint pos_xy; // position within the cell, 16-bit fixed point
+    uint pos_z_vel_x; // z position within the cell, half precision x velocity
+    uint vel_yz; // half precision y and z velocity
+    uint id; // stable across reordering of the particle buffer
+};
+#else
 struct Particle {
     vec4 color;
     vec3 pos;
+    uint id; // stable across reordering of the particle buffer
     vec3 vel;
 };
+#endif
 
-struct GridCell {
-    vec3 pos;
-    int type;
-    vec3 vel;
-    float rhs;
-    vec3 old_vel;
+// The grid is stored as one array per field group (see GridCell.hpp), so
+// kernels only fetch the fields they use. Cell positions aren't stored; use
+// get_world_coord.
+
+struct GridPressure {
+    float pressure;
+    float pressure_guess;
+    float rhs; // negative divergence for pressure solve
+};
+
+struct GridCoefficients {
+    // elements of A matrix in pressure solve
     float a_diag;
     float a_x;
     float a_y;
     float a_z;
-    float pressure_guess;
-    float pressure;
+};
+
+struct GridFlags {
+    int type;
     int vel_unknown;
 };
 
@@ -33,8 +53,58 @@ layout(std430, binding=0) restrict buffer ParticleBlock {
     Particle particle[];
 };
 
-layout(std430, binding=1) restrict buffer GridBlock {
-    GridCell cell[];
+layout(std430, binding=1) restrict buffer GridVelocityBlock {
+    vec3 cell_vel[]; // velocity component at each of three faces on cell cube (not a real vector)
+};
+
+layout(std430, binding=11) restrict buffer GridOldVelocityBlock {
+    vec3 cell_old_vel[]; // old velocity for FLIP update
+};
+
+layout(std430, binding=12) restrict buffer GridPressureBlock {
+    GridPressure cell_pressure[];
+};
+
+layout(std430, binding=13) restrict buffer GridCoefficientBlock {
+    GridCoefficients cell_a[];
+};
+
+layout(std430, binding=14) restrict buffer GridFlagBlock {
+    GridFlags cell_flags[];
+};
+
+// particle count and the fluid's extents, with indirect dispatches sized from
+// them on the GPU (see FluidExtent.hpp)
+layout(std430, binding=17) restrict buffer FluidExtentBlock {
+    uint grid_groups_x; // indirect dispatch over the tiles of the active box
+    uint grid_groups_y;
+    uint grid_groups_z;
+    uint particle_groups_x; // indirect dispatch over the particles
+    uint particle_groups_y;
+    uint particle_groups_z;
+    uint num_particles; // particles in use, the first num_particles entries of particle[]
+    uint num_active_cells; // cells in the active box
+    ivec3 grid_tile_origin; // tile of the first workgroup of grid_groups
+    uint next_particle_id; // id for the next particle added on the GPU
+    ivec3 particle_min; // cell bounds of the particles, accumulated by fluid_extent_reduce
+    ivec3 particle_max;
+    ivec3 occupied_min; // cells within FLUID_MARGIN of a particle last step
+    ivec3 occupied_max;
+    ivec3 active_min; // box covered by grid kernels this step
+    ivec3 active_max;
+};
+
+uint particle_count() {
+    return num_particles;
+}
+
+// bricks covered by grid kernels when the grid is sparse (see SparseGrid.hpp)
+layout(std430, binding=15) restrict buffer ActiveBrickBlock {
+    uint brick_groups_x; // indirect dispatch over the tiles of the active bricks
+    uint brick_groups_y;
+    uint brick_groups_z;
+    uint num_active_bricks;
+    uint active_brick[]; // brick coordinates, 10 bits per axis (see pack_brick_coord)
 };
 
 layout(std430, binding=2) restrict buffer DebugLinesBlock {
@@ -50,6 +120,22 @@ ivec3 grid_cell_dim = grid_dim - ivec3(1);
 vec3 bounds_size = bounds_max - bounds_min;
 vec3 cell_size = bounds_size / vec3(grid_dim - ivec3(1));
 
+// cells around the particles that grid kernels have to cover: particles touch
+// the cells next to theirs, and the kernels there read one cell further
+const int FLUID_MARGIN = 2;
+
+const int BRICK_SIZE = 8; // cells along each axis of a brick of the sparse grid
+ivec3 brick_dim = (grid_dim + ivec3(BRICK_SIZE - 1)) / BRICK_SIZE;
+
+// packed so grid kernels don't need integer divisions to find their brick
+uint pack_brick_coord(uvec3 coord) {
+    return coord.x | (coord.y << 10) | (coord.z << 20);
+}
+
+ivec3 unpack_brick_coord(uint bits) {
+    return ivec3(bits & 0x3ffu, (bits >> 10) & 0x3ffu, bits >> 20);
+}
+
 const float density = 1; // kg/m^3
 
 bool grid_in_bounds(ivec3 grid_coord) {
@@ -81,3 +167,60 @@ ivec3 offset_clamped(ivec3 base_coord, ivec3 dimension_offset) {
         max_size.z = grid_dim.z;
     return clamp(base_coord + dimension_offset, ivec3(0), max_size - ivec3(1));
 }
+
+// particle access, independent of the particle format
+
+#ifdef COMPACT_PARTICLES
+const uint PARTICLE_CELL_MASK = 0x0fffffffu;
+
+vec3 unpack_particle_pos(uint cell_palette, uint pos_xy, uint pos_z_vel_x) {
+    int index = int(cell_palette & PARTICLE_CELL_MASK);
+    ivec3 coord = ivec3(index % grid_dim.x, (index / grid_dim.x) % grid_dim.y, index / (grid_dim.x * grid_dim.y));
+    uvec3 fixed_pos = uvec3(pos_xy & 0xffffu, pos_xy >> 16, pos_z_vel_x & 0xffffu);
+    return get_world_coord(coord, ivec3(0)) + (vec3(fixed_pos) + 0.5) / 65536.0 * cell_size;
+}
+
+vec3 unpack_particle_vel(uint pos_z_vel_x, uint vel_yz) {
+    return vec3(unpackHalf2x16(pos_z_vel_x >> 16).x, unpackHalf2x16(vel_yz));
+}
+
+vec3 particle_pos(uint i) {
+    return unpack_particle_pos(particle[i].cell_palette, particle[i].pos_xy, particle[i].pos_z_vel_x);
+}
+
+vec3 particle_vel(uint i) {
+    return unpack_particle_vel(particle[i].pos_z_vel_x, particle[i].vel_yz);
+}
+
+void set_particle_pos_vel(uint i, vec3 pos, vec3 vel) {
+    // truncate to the containing cell and the fixed point step below pos; unpacking adds half a step back
+    ivec3 coord = clamp(get_grid_coord(pos, ivec3(0)), ivec3(0), grid_cell_dim - ivec3(1));
+    uvec3 fixed_pos = uvec3(clamp((pos - get_world_coord(coord, ivec3(0))) / cell_size * 65536.0, vec3(0), vec3(65535)));
+    particle[i].cell_palette = (particle[i].cell_palette & ~PARTICLE_CELL_MASK) | uint(get_grid_index(coord));
+    particle[i].pos_xy = fixed_pos.x | (fixed_pos.y << 16);
+    particle[i].pos_z_vel_x = fixed_pos.z | (packHalf2x16(vec2(vel.x, 0)) << 16);
+    particle[i].vel_yz = packHalf2x16(vel.yz);
+}
+
+void set_particle_vel(uint i, vec3 vel) {
+    particle[i].pos_z_vel_x = (particle[i].pos_z_vel_x & 0xffffu) | (packHalf2x16(vec2(vel.x, 0)) << 16);
+    particle[i].vel_yz = packHalf2x16(vel.yz);
+}
+#else
+vec3 particle_pos(uint i) {
+    return particle[i].pos;
+}
+
+vec3 particle_vel(uint i) {
+    return particle[i].vel;
+}
+
+void set_particle_pos_vel(uint i, vec3 pos, vec3 vel) {
+    particle[i].pos = pos;
+    particle[i].vel = vel;
+}
+
+void set_particle_vel(uint i, vec3 vel) {
+    particle[i].vel = vel;
+}
+#endif
@@ -1,60 +1,76 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+// velocity and vel_unknown of the tile and its halo
+shared vec3 tile_vel[TILE_HALO_SIZE];
+shared int tile_unknown[TILE_HALO_SIZE];
 
 void main() {
-    ivec3 grid_pos = ivec3(gl_WorkGroupID);
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        tile_vel[i] = vec3(0);
+        tile_unknown[i] = 1;
+        if (in_grid(pos)) {
+            uint j = get_grid_index(pos);
+            tile_vel[i] = tile_vel[j];
+            tile_unknown[i] = tile_unknown[j];
+        }
+    }
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
     uint index = get_grid_index(grid_pos);
 
-    if (cell[index].vel_unknown == 0) {
+    if (tile_unknown[tile_index(grid_pos)] == 0) {
         return;
     }
 
     vec3 sum = vec3(0);
     int count = 0;
     if (grid_pos.x > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(-1, 0, 0));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(-1, 0, 0));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     if (grid_pos.y > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(0, -1, 0));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(0, -1, 0));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     if (grid_pos.z > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 0, -1));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(0, 0, -1));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     if (grid_pos.x < grid_dim.x - 1) {
-        uint j = get_grid_index(grid_pos + ivec3(1, 0, 0));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(1, 0, 0));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     if (grid_pos.y < grid_dim.y - 1) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 1, 0));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(0, 1, 0));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     if (grid_pos.z < grid_dim.z - 1) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 0, 1));
-        if (cell[j].vel_unknown < 1) {
-            sum += cell[j].vel;
+        int j = tile_index(grid_pos + ivec3(0, 0, 1));
+        if (tile_unknown[j] < 1) {
+            sum += tile_vel[j];
             count++;
         }
     }
     
     if (count > 0) {
-        cell[index].vel = sum / count;
-        cell[index].vel_unknown = 2;
+        cell_vel[index] = sum / count;
+        cell_flags[index].vel_unknown = 2;
     }
 }
@@ -0,0 +1,50 @@
+// size the indirect dispatches from the particle bounds
+//
+// Grid kernels cover the cells within FLUID_MARGIN of a particle this step or
+// last step, so cells the fluid just left go through the pipeline once more
+// without fluid and are left as a dispatch over the whole grid would have them.
+
+layout(local_size_x = 1) in;
+
+uniform ivec3 tile_size;
+uniform uint particle_group_size;
+
+void main() {
+    ivec3 occupied_min_now = max(particle_min - ivec3(FLUID_MARGIN), ivec3(0));
+    ivec3 occupied_max_now = min(particle_max + ivec3(FLUID_MARGIN), grid_dim - ivec3(1));
+    if (particle_max.x < 0) {
+        // no particles
+        occupied_min_now = grid_dim;
+        occupied_max_now = ivec3(-1);
+    }
+
+    active_min = min(occupied_min, occupied_min_now);
+    active_max = max(occupied_max, occupied_max_now);
+    occupied_min = occupied_min_now;
+    occupied_max = occupied_max_now;
+
+    if (any(greaterThan(active_min, active_max))) {
+        grid_tile_origin = ivec3(0);
+        grid_groups_x = 0u;
+        grid_groups_y = 0u;
+        grid_groups_z = 0u;
+        num_active_cells = 0u;
+    } else {
+        ivec3 first_tile = active_min / tile_size;
+        uvec3 groups = uvec3(active_max / tile_size - first_tile + ivec3(1));
+        uvec3 cells = uvec3(active_max - active_min + ivec3(1));
+        grid_tile_origin = first_tile;
+        grid_groups_x = groups.x;
+        grid_groups_y = groups.y;
+        grid_groups_z = groups.z;
+        num_active_cells = cells.x * cells.y * cells.z;
+    }
+
+    particle_groups_x = (num_particles + particle_group_size - 1u) / particle_group_size;
+    particle_groups_y = 1u;
+    particle_groups_z = 1u;
+
+    // start the next step's reduction
+    particle_min = grid_dim;
+    particle_max = ivec3(-1);
+}
@@ -0,0 +1,34 @@
+// accumulate the cell bounds of the particles into particle_min/particle_max,
+// reduced in shared memory so each workgroup does one global atomic per bound
+
+shared ivec3 group_min;
+shared ivec3 group_max;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        group_min = grid_dim;
+        group_max = ivec3(-1);
+    }
+    barrier();
+
+    uint index = gl_GlobalInvocationID.x;
+    if (index < particle_count()) {
+        ivec3 cell = clamp(get_grid_coord(particle_pos(index), ivec3(0)), ivec3(0), grid_dim - ivec3(1));
+        atomicMin(group_min.x, cell.x);
+        atomicMin(group_min.y, cell.y);
+        atomicMin(group_min.z, cell.z);
+        atomicMax(group_max.x, cell.x);
+        atomicMax(group_max.y, cell.y);
+        atomicMax(group_max.z, cell.z);
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0 && group_max.x >= 0) {
+        atomicMin(particle_min.x, group_min.x);
+        atomicMin(particle_min.y, group_min.y);
+        atomicMin(particle_min.z, group_min.z);
+        atomicMax(particle_max.x, group_max.x);
+        atomicMax(particle_max.y, group_max.y);
+        atomicMax(particle_max.z, group_max.z);
+    }
+}
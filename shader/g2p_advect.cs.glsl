@@ -0,0 +1,14 @@
+// grid_to_particle.cs.glsl followed by particle_advect.cs.glsl, reading and
+// writing each particle once
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= particle_count()) {
+        return;
+    }
+
+    vec3 pos = particle_pos(index);
+    vec3 vel = grid_to_particle_vel(pos, particle_vel(index));
+    advect(pos, vel);
+    set_particle_pos_vel(index, pos, vel);
+}
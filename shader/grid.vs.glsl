@@ -1,10 +1,9 @@
-layout (location=0) in vec3 pos;
-layout (location=1) in vec3 vel;
-layout (location=2) in int type;
-layout (location=3) in float rhs;
-layout (location=4) in vec4 a;
-layout (location=5) in float pressure;
-layout (location=6) in int vel_unknown;
+layout (location=0) in vec3 vel;
+layout (location=1) in int type;
+layout (location=2) in float rhs;
+layout (location=3) in vec4 a;
+layout (location=4) in float pressure;
+layout (location=5) in int vel_unknown;
 
 flat out int vs_display_mode;
 flat out int vs_discard;
@@ -19,7 +18,9 @@ uniform int display_mode;
 void main() {
     vs_discard = 0;
     vs_display_mode = display_mode;
-    vs_pos = pos;
+    // one vertex per cell, in grid index order
+    ivec3 grid_pos = ivec3(gl_VertexID % grid_dim.x, (gl_VertexID / grid_dim.x) % grid_dim.y, gl_VertexID / (grid_dim.x * grid_dim.y));
+    vs_pos = get_world_coord(grid_pos, ivec3(0));
     vs_vel = vel;
     vs_color = vec3(1.0, 0, 1.0);
 
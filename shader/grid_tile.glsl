@@ -0,0 +1,82 @@
+// Workgroup tiling for grid kernels. Each workgroup covers a TILE_X x TILE_Y x
+// TILE_Z block of cells; the tile size is defined by the host when the shader
+// is compiled (see Fluid::grid_kernel). Kernels with a stencil stage the block
+// plus a one cell halo in shared memory, indexed with tile_index(). With
+// SPARSE_GRID, workgroups only cover the tiles of the active bricks; with
+// INDIRECT_DISPATCH, the tiles of the fluid's bounding box.
+
+#ifndef TILE_X
+#define TILE_X 8
+#endif
+#ifndef TILE_Y
+#define TILE_Y 8
+#endif
+#ifndef TILE_Z
+#define TILE_Z 4
+#endif
+
+layout(local_size_x = TILE_X, local_size_y = TILE_Y, local_size_z = TILE_Z) in;
+
+const int TILE_SIZE = TILE_X * TILE_Y * TILE_Z;
+const ivec3 TILE_HALO_DIM = ivec3(TILE_X + 2, TILE_Y + 2, TILE_Z + 2);
+const int TILE_HALO_SIZE = (TILE_X + 2) * (TILE_Y + 2) * (TILE_Z + 2);
+
+bool in_grid(ivec3 grid_pos) {
+    return all(greaterThanEqual(grid_pos, ivec3(0))) && all(lessThan(grid_pos, grid_dim));
+}
+
+#ifdef SPARSE_GRID
+const ivec3 BRICK_TILES = ivec3(BRICK_SIZE) / ivec3(TILE_X, TILE_Y, TILE_Z);
+
+// tile coordinate of this workgroup: x picks the tile within the brick, y and
+// z the entry of active_brick (see brick_dispatch.cs.glsl)
+ivec3 active_tile_group() {
+    uint entry = gl_WorkGroupID.y + gl_WorkGroupID.z * gl_NumWorkGroups.y;
+    if (entry >= num_active_bricks) {
+        // past the end of the list, a tile whose halo is entirely outside the grid
+        return grid_dim / ivec3(TILE_X, TILE_Y, TILE_Z) + ivec3(1);
+    }
+    ivec3 brick_coord = unpack_brick_coord(active_brick[entry]);
+    int t = int(gl_WorkGroupID.x);
+    ivec3 tile = ivec3(t % BRICK_TILES.x, (t / BRICK_TILES.x) % BRICK_TILES.y, t / (BRICK_TILES.x * BRICK_TILES.y));
+    return brick_coord * BRICK_TILES + tile;
+}
+
+// looked up once per invocation rather than at every tile_group() call
+ivec3 active_tile = active_tile_group();
+
+ivec3 tile_group() {
+    return active_tile;
+}
+#elif defined(INDIRECT_DISPATCH)
+// tile coordinate of this workgroup, within the active box (see fluid_extent_dispatch.cs.glsl)
+ivec3 tile_group() {
+    return grid_tile_origin + ivec3(gl_WorkGroupID);
+}
+#else
+// tile coordinate of this workgroup
+ivec3 tile_group() {
+    return ivec3(gl_WorkGroupID);
+}
+#endif
+
+// grid position of this invocation
+ivec3 tile_cell() {
+    return tile_group() * ivec3(TILE_X, TILE_Y, TILE_Z) + ivec3(gl_LocalInvocationID);
+}
+
+// grid position of the first halo cell of this workgroup's tile
+ivec3 tile_halo_origin() {
+    return tile_group() * ivec3(TILE_X, TILE_Y, TILE_Z) - ivec3(1);
+}
+
+// grid position of entry i of the tile with halo
+ivec3 tile_halo_pos(int i) {
+    return tile_halo_origin() + ivec3(i % TILE_HALO_DIM.x, (i / TILE_HALO_DIM.x) % TILE_HALO_DIM.y, i / (TILE_HALO_DIM.x * TILE_HALO_DIM.y));
+}
+
+// entry of the tile with halo for a grid position at most one cell outside the tile
+int tile_index(ivec3 grid_pos) {
+    ivec3 c = grid_pos - tile_halo_origin();
+    return c.z * TILE_HALO_DIM.y * TILE_HALO_DIM.x + c.y * TILE_HALO_DIM.x + c.x;
+}
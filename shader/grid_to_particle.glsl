@@ -0,0 +1,74 @@
+uniform float pic_flip_blend;
+
+vec3 lerp_vel(vec3 pos, ivec3 component) {
+    // interpolates velocity from 8 nearby grid corners
+    // dimension_offset should correspond to the component of velocity being interpolated
+    // other components of interpolated velocity are not meaningful
+
+    // this part will change for each u, v, w
+    ivec3 dimension_offset = ivec3(1) - component;
+    ivec3 base_coord = get_grid_coord(pos, -dimension_offset);
+    vec3 weights = (pos - get_world_coord(base_coord, dimension_offset)) / cell_size;
+
+    // trilinearly interpolate 8 nearby grid velocity values to particle
+    // x interpolation (gets values from all 8 grid corners)
+    vec3 vel_x1 = cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 0, 0)))] * (1 - weights.x) 
+                + cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 0, 0)))] * weights.x;
+    vec3 vel_x2 = cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 1, 0)))] * (1 - weights.x) 
+                + cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 1, 0)))] * weights.x;
+    vec3 vel_x3 = cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 0, 1)))] * (1 - weights.x) 
+                + cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 0, 1)))] * weights.x;
+    vec3 vel_x4 = cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 1, 1)))] * (1 - weights.x) 
+                + cell_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 1, 1)))] * weights.x;
+    
+    // y interpolation
+    vec3 vel_y1 = vel_x1 * (1 - weights.y) + vel_x2 * weights.y;
+    vec3 vel_y2 = vel_x3 * (1 - weights.y) + vel_x4 * weights.y;
+
+    // z interpolation
+    vec3 vel = vel_y1 * (1 - weights.z) + vel_y2 * weights.z;
+    return vel;
+}
+
+vec3 lerp_old_vel(vec3 pos, ivec3 component) {
+    // interpolates delta velocity from 8 nearby grid corners
+    // dimension_offset should correspond to the component of velocity being interpolated
+    // other components of interpolated velocity are not meaningful
+
+    ivec3 dimension_offset = ivec3(1) - component;
+    ivec3 base_coord = get_grid_coord(pos, -dimension_offset);
+    vec3 weights = (pos - get_world_coord(base_coord, dimension_offset)) / cell_size;
+
+    // trilinearly interpolate 8 nearby grid velocity values to particle
+    // x interpolation (gets values from all 8 grid corners)
+    vec3 vel_x1 = cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 0, 0)))] * (1 - weights.x) 
+                + cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 0, 0)))] * weights.x;
+    vec3 vel_x2 = cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 1, 0)))] * (1 - weights.x) 
+                + cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 1, 0)))] * weights.x;
+    vec3 vel_x3 = cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 0, 1)))] * (1 - weights.x) 
+                + cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 0, 1)))] * weights.x;
+    vec3 vel_x4 = cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(0, 1, 1)))] * (1 - weights.x) 
+                + cell_old_vel[get_grid_index(offset_clamped(base_coord, ivec3(1, 1, 1)))] * weights.x;
+    
+    // y interpolation
+    vec3 vel_y1 = vel_x1 * (1 - weights.y) + vel_x2 * weights.y;
+    vec3 vel_y2 = vel_x3 * (1 - weights.y) + vel_x4 * weights.y;
+
+    // z interpolation
+    vec3 vel = vel_y1 * (1 - weights.z) + vel_y2 * weights.z;
+    return vel;
+}
+
+// PIC/FLIP blend of the grid velocity at pos with the particle velocity vel
+vec3 grid_to_particle_vel(vec3 pos, vec3 vel) {
+    float u = lerp_vel(pos, ivec3(1, 0, 0)).x;
+    float v = lerp_vel(pos, ivec3(0, 1, 0)).y;
+    float w = lerp_vel(pos, ivec3(0, 0, 1)).z;
+    float ou = lerp_old_vel(pos, ivec3(1, 0, 0)).x;
+    float ov = lerp_old_vel(pos, ivec3(0, 1, 0)).y;
+    float ow = lerp_old_vel(pos, ivec3(0, 0, 1)).z;
+
+    vec3 pic = vec3(u, v, w);
+    vec3 flip = vel + vec3(u, v, w) - vec3(ou, ov, ow);
+    return pic * (1 - pic_flip_blend) + flip * pic_flip_blend;
+}
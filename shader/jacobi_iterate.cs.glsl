@@ -1,49 +1,66 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
 uniform float dt;
 
+// pressure_guess and off-diagonal coefficients of the tile and its halo
+shared float tile_guess[TILE_HALO_SIZE];
+shared vec3 tile_a[TILE_HALO_SIZE];
+
 void main() {
-    ivec3 grid_pos = ivec3(gl_WorkGroupID);
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        tile_guess[i] = 0;
+        tile_a[i] = vec3(0);
+        if (in_grid(pos)) {
+            uint j = get_grid_index(pos);
+            tile_guess[i] = cell_pressure[j].pressure_guess;
+            tile_a[i] = vec3(cell_a[j].a_x, cell_a[j].a_y, cell_a[j].a_z);
+        }
+    }
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
     uint index = get_grid_index(grid_pos);
+    int t = tile_index(grid_pos);
 
-    if (cell[index].type == AIR) {
-        cell[index].pressure = 0;
+    if (cell_flags[index].type == AIR) {
+        cell_pressure[index].pressure = 0;
         return;
     }
-    if (cell[index].type == SOLID) {
+    if (cell_flags[index].type == SOLID) {
         // invalid
-        cell[index].pressure = 0;
+        cell_pressure[index].pressure = 0;
         return;
     }
 
     float L_Up = 0;
 
     if (grid_pos.x > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(-1, 0, 0));
-        L_Up += cell[j].a_x * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(-1, 0, 0));
+        L_Up += tile_a[j].x * tile_guess[j];
     }
     if (grid_pos.y > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(0, -1, 0));
-        L_Up += cell[j].a_y * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(0, -1, 0));
+        L_Up += tile_a[j].y * tile_guess[j];
     }
     if (grid_pos.z > 0) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 0, -1));
-        L_Up += cell[j].a_z * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(0, 0, -1));
+        L_Up += tile_a[j].z * tile_guess[j];
     }
 
     if (grid_pos.x < grid_dim.x - 2) {
-        uint j = get_grid_index(grid_pos + ivec3(1, 0, 0));
-        L_Up += cell[index].a_x * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(1, 0, 0));
+        L_Up += tile_a[t].x * tile_guess[j];
     }
     if (grid_pos.y < grid_dim.y - 2) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 1, 0));
-        L_Up += cell[index].a_y * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(0, 1, 0));
+        L_Up += tile_a[t].y * tile_guess[j];
     }
     if (grid_pos.z < grid_dim.z - 2) {
-        uint j = get_grid_index(grid_pos + ivec3(0, 0, 1));
-        L_Up += cell[index].a_z * cell[j].pressure_guess;
+        int j = tile_index(grid_pos + ivec3(0, 0, 1));
+        L_Up += tile_a[t].z * tile_guess[j];
     }
 
-    if (cell[index].a_diag != 0)
-        cell[index].pressure = 1.0 / cell[index].a_diag * (cell[index].rhs - L_Up);
+    if (cell_a[index].a_diag != 0)
+        cell_pressure[index].pressure = 1.0 / cell_a[index].a_diag * (cell_pressure[index].rhs - L_Up);
 }
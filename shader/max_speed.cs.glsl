@@ -0,0 +1,35 @@
+// fastest velocity component next to the fluid, in cells per second, for the
+// adaptive time step (see Fluid::step_frame)
+
+layout(std430, binding=19) restrict buffer MaxSpeedBlock {
+    uint max_speed_bits; // floatBitsToUint of the speed; non-negative floats order like their bits
+};
+
+shared uint tile_max_bits;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0u)
+        tile_max_bits = 0u;
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (in_grid(grid_pos)) {
+        uint index = get_grid_index(grid_pos);
+        bool fluid = cell_flags[index].type == FLUID;
+        // a face velocity counts if the cell on either side is fluid, as in pressure_update
+        vec3 speed = vec3(0);
+        for (int axis = 0; axis < 3; ++axis) {
+            ivec3 lower = grid_pos;
+            lower[axis] -= 1;
+            if (fluid || (lower[axis] >= 0 && cell_flags[get_grid_index(lower)].type == FLUID))
+                speed[axis] = abs(cell_vel[index][axis]) / cell_size[axis];
+        }
+        float max_speed = max(speed.x, max(speed.y, speed.z));
+        if (max_speed > 0)
+            atomicMax(tile_max_bits, floatBitsToUint(max_speed));
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0u && tile_max_bits > 0u)
+        atomicMax(max_speed_bits, tile_max_bits);
+}
@@ -0,0 +1,10 @@
+// classify the cells of multigrid level 0 from the grid
+
+void main() {
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        int type = cell_flags[index].type;
+        if (type == FLUID && cell_a[index].a_diag == 0)
+            type = SOLID; // not coupled to anything, pressure stays 0
+        solver_type[type_offset + index] = type;
+    }
+}
@@ -0,0 +1,16 @@
+// add the correction of the next coarser multigrid level to x, piecewise constant
+
+uniform int x_offset;
+uniform ivec3 coarse_dim;
+uniform int coarse_x_offset;
+
+void main() {
+    if (converged())
+        return;
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        if (!is_unknown(index))
+            continue;
+        ivec3 cc = level_coord(index) / 2;
+        solver_data[x_offset + index] += solver_data[coarse_x_offset + cc.z * coarse_dim.y * coarse_dim.x + cc.y * coarse_dim.x + cc.x];
+    }
+}
@@ -0,0 +1,31 @@
+// restrict the residual b - Ax of a multigrid level to the next coarser one, and clear its x
+
+uniform int x_offset;
+uniform int b_offset;
+uniform ivec3 coarse_dim;
+uniform int coarse_x_offset;
+uniform int coarse_b_offset;
+uniform float restrict_scale;
+
+void main() {
+    if (converged())
+        return;
+    int coarse_size = coarse_dim.x * coarse_dim.y * coarse_dim.z;
+    for (int coarse = int(gl_GlobalInvocationID.x); coarse < coarse_size; coarse += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        ivec3 cc = ivec3(coarse % coarse_dim.x, (coarse / coarse_dim.x) % coarse_dim.y, coarse / (coarse_dim.x * coarse_dim.y));
+        float sum = 0;
+        for (int k = 0; k < 8; ++k) {
+            ivec3 c = 2 * cc + ivec3(k & 1, (k >> 1) & 1, k >> 2);
+            if (any(greaterThanEqual(c, level_dim)))
+                continue;
+            int index = level_index(c);
+            if (!is_unknown(index))
+                continue;
+            float diag, off_sum;
+            level_row(c, index, x_offset, diag, off_sum);
+            sum += solver_data[b_offset + index] - diag * solver_data[x_offset + index] - off_sum;
+        }
+        solver_data[coarse_b_offset + coarse] = sum * restrict_scale;
+        solver_data[coarse_x_offset + coarse] = 0;
+    }
+}
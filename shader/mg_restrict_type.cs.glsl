@@ -0,0 +1,21 @@
+// classify the cells of a coarse multigrid level from their (up to) 8 children
+
+uniform ivec3 fine_dim;
+uniform int fine_type_offset;
+
+void main() {
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        ivec3 c = level_coord(index);
+        bool any_fluid = false;
+        bool any_air = false;
+        for (int k = 0; k < 8; ++k) {
+            ivec3 f = 2 * c + ivec3(k & 1, (k >> 1) & 1, k >> 2);
+            if (any(greaterThanEqual(f, fine_dim)))
+                continue;
+            int type = solver_type[fine_type_offset + f.z * fine_dim.y * fine_dim.x + f.y * fine_dim.x + f.x];
+            any_fluid = any_fluid || type == FLUID;
+            any_air = any_air || type == AIR;
+        }
+        solver_type[type_offset + index] = any_fluid ? FLUID : (any_air ? AIR : SOLID);
+    }
+}
@@ -0,0 +1,22 @@
+// one red-black Gauss-Seidel half sweep of a multigrid level, in place on x
+
+uniform int x_offset;
+uniform int b_offset;
+uniform int color; // parity of x + y + z of the cells updated
+uniform bool zero_guess; // treat x as 0 (first sweep of a V-cycle)
+
+void main() {
+    if (converged())
+        return;
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        ivec3 c = level_coord(index);
+        if (((c.x + c.y + c.z) & 1) != color || !is_unknown(index))
+            continue;
+
+        float diag, off_sum;
+        level_row(c, index, x_offset, diag, off_sum);
+        if (zero_guess)
+            off_sum = 0;
+        solver_data[x_offset + index] = diag != 0 ? (solver_data[b_offset + index] - off_sum) / diag : 0;
+    }
+}
@@ -0,0 +1,46 @@
+// semi-Lagrangian advection of last step's grid velocity and depth, for the
+// interior cells that have no particles to carry them
+
+uniform float dt;
+
+// depth trilinearly interpolated between cell centers
+float lerp_depth(vec3 pos) {
+    vec3 center_coord = (pos - bounds_min) / cell_size - vec3(0.5);
+    ivec3 base_coord = ivec3(floor(center_coord));
+    vec3 weights = center_coord - vec3(base_coord);
+    float depth = 0;
+    for (int i = 0; i < 8; ++i) {
+        ivec3 corner = ivec3(i & 1, (i >> 1) & 1, i >> 2);
+        ivec3 coord = clamp(base_coord + corner, ivec3(0), grid_cell_dim - ivec3(1));
+        vec3 w = mix(vec3(1) - weights, weights, vec3(corner));
+        depth += w.x * w.y * w.z * cell_band[get_grid_index(coord)].depth;
+    }
+    return depth;
+}
+
+vec3 grid_vel_at(vec3 pos) {
+    return vec3(lerp_vel(pos, ivec3(1, 0, 0)).x, lerp_vel(pos, ivec3(0, 1, 0)).y, lerp_vel(pos, ivec3(0, 0, 1)).z);
+}
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    // each component is stored at its own face (see lerp_vel)
+    vec3 carried_vel;
+    for (int axis = 0; axis < 3; ++axis) {
+        ivec3 component = ivec3(0);
+        component[axis] = 1;
+        vec3 face_pos = get_world_coord(grid_pos, ivec3(1) - component);
+        vec3 departure = face_pos - grid_vel_at(face_pos) * dt;
+        carried_vel[axis] = lerp_vel(departure, component)[axis];
+    }
+    vec3 center = get_world_coord(grid_pos, ivec3(1));
+    float carried_depth = lerp_depth(center - grid_vel_at(center) * dt);
+
+    // the velocity is read by neighboring invocations, so write to the carried fields only
+    cell_band[index].carried_vel = carried_vel;
+    cell_band[index].carried_depth = carried_depth;
+}
@@ -0,0 +1,12 @@
+// narrow band FLIP state (see Fluid::narrow_band), NARROW_BAND is the band
+// width in cells
+
+struct NarrowBandCell {
+    vec3 carried_vel; // last step's grid velocity, advected to this step
+    float carried_depth; // last step's depth, advected to this step
+    float depth; // distance in cells to the nearest AIR cell, capped at NARROW_BAND + 1
+};
+
+layout(std430, binding=18) restrict buffer GridNarrowBandBlock {
+    NarrowBandCell cell_band[];
+};
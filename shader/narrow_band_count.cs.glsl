@@ -0,0 +1,11 @@
+// clamp the particle count to the particle buffer after reseeding and resize
+// the particle dispatch
+
+layout(local_size_x = 1) in;
+
+uniform uint particle_group_size;
+
+void main() {
+    num_particles = min(num_particles, uint(particle.length()));
+    particle_groups_x = (num_particles + particle_group_size - 1u) / particle_group_size;
+}
@@ -0,0 +1,37 @@
+// one sweep of the distance in cells to the nearest AIR cell, capped at
+// NARROW_BAND + 1
+//
+// Sweep 0 sets AIR cells to 0 and the others to the cap; every later sweep
+// lowers each cell to one more than its lowest neighbor. Values only go down
+// towards the distance, so updating in place is safe, and NARROW_BAND + 1
+// sweeps after the first reach it. Walls don't count as surface.
+
+uniform int sweep;
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    // the last layer of grid positions isn't made of cells
+    if (cell_flags[index].type == AIR || !all(lessThan(grid_pos, grid_cell_dim))) {
+        cell_band[index].depth = 0;
+        return;
+    }
+    if (sweep == 0) {
+        cell_band[index].depth = float(NARROW_BAND + 1);
+        return;
+    }
+
+    float depth = cell_band[index].depth;
+    for (int axis = 0; axis < 3; ++axis) {
+        ivec3 offset = ivec3(0);
+        offset[axis] = 1;
+        if (grid_pos[axis] > 0)
+            depth = min(depth, cell_band[get_grid_index(grid_pos - offset)].depth + 1);
+        if (grid_pos[axis] < grid_cell_dim[axis] - 1)
+            depth = min(depth, cell_band[get_grid_index(grid_pos + offset)].depth + 1);
+    }
+    cell_band[index].depth = depth;
+}
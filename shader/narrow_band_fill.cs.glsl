@@ -0,0 +1,15 @@
+// make the cells of the carried interior that got no particles fluid, with
+// the carried velocity
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    // only cells can be fluid, not the last layer of grid positions
+    if (!all(lessThan(grid_pos, grid_cell_dim)) || !in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    if (cell_flags[index].type != FLUID && cell_band[index].carried_depth > float(NARROW_BAND) + 0.5) {
+        cell_flags[index].type = FLUID;
+        cell_vel[index] = cell_band[index].carried_vel;
+    }
+}
@@ -0,0 +1,39 @@
+// seed the fluid cells of the band that have no particles, where the band
+// moved into the carried interior
+//
+// New particles go after the particles in use, up to the capacity of the
+// particle buffer (see narrow_band_count.cs.glsl). They take the grid velocity
+// from before the pressure update, so grid_to_particle's FLIP update gives them
+// the new grid velocity.
+
+uniform int particle_density;
+uniform uint seed;
+uniform vec4 seed_color; // for the float particle format; compact particles get palette entry 0
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    if (!all(lessThan(grid_pos, grid_cell_dim)) || !in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    if (cell_flags[index].type != FLUID || cell_band[index].depth > float(NARROW_BAND) || cell_range[index].count > 0u)
+        return;
+
+    uint first = atomicAdd(num_particles, uint(particle_density));
+    uint first_id = atomicAdd(next_particle_id, uint(particle_density));
+    vec3 cell_min = get_world_coord(grid_pos, ivec3(0));
+    for (uint i = 0u; i < uint(particle_density); ++i) {
+        uint p = first + i;
+        if (p >= uint(particle.length()))
+            break;
+        vec3 pos = cell_min + hash3(uvec3(index, i, seed)) * cell_size;
+        vec3 vel = vec3(lerp_old_vel(pos, ivec3(1, 0, 0)).x, lerp_old_vel(pos, ivec3(0, 1, 0)).y, lerp_old_vel(pos, ivec3(0, 0, 1)).z);
+#ifdef COMPACT_PARTICLES
+        particle[p].cell_palette = 0u;
+#else
+        particle[p].color = seed_color;
+#endif
+        particle[p].id = first_id + i;
+        set_particle_pos_vel(p, pos, vel);
+    }
+}
@@ -1,7 +1,3 @@
-layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
-
-uniform int start_index;
-
 void scatter_part(ivec3 coord, vec3 weights, vec3 vel) {
     int index = get_grid_index(coord);
     float weight = weights.x * weights.y * weights.z;
@@ -20,14 +16,14 @@ void scatter_part(ivec3 coord, vec3 weights, vec3 vel) {
     }
 }
 
-void scatter_vel(uint index, ivec3 component) {
+void scatter_vel(vec3 pos, vec3 vel, ivec3 component) {
     ivec3 offset =  component;
-    ivec3 base_coord = get_grid_coord(particle[index].pos, -offset);
+    ivec3 base_coord = get_grid_coord(pos, -offset);
 
     // interpolation weights
-    vec3 wgt = (particle[index].pos - get_world_coord(base_coord, offset)) / cell_size;
+    vec3 wgt = (pos - get_world_coord(base_coord, offset)) / cell_size;
 
-    vec3 comp_vel = vec3(component) * particle[index].vel;
+    vec3 comp_vel = vec3(component) * vel;
     scatter_part(offset_clamped(base_coord, ivec3(0, 0, 0)), vec3(wgt.x, wgt.y, wgt.z), comp_vel);
     scatter_part(offset_clamped(base_coord, ivec3(1, 0, 0)), vec3(1-wgt.x, wgt.y, wgt.z), comp_vel);
     scatter_part(offset_clamped(base_coord, ivec3(0, 1, 0)), vec3(wgt.x, 1-wgt.y, wgt.z), comp_vel);
@@ -39,17 +35,19 @@ void scatter_vel(uint index, ivec3 component) {
 }
 
 void main() {
-    uint index = start_index + gl_LocalInvocationIndex.x;
+    uint index = gl_GlobalInvocationID.x;
 
-    if (index >= particle.length()) {
+    if (index >= particle_count()) {
         return;
     }
 
-    ivec3 base_coord = get_grid_coord(particle[index].pos, ivec3(0));
+    vec3 pos = particle_pos(index);
+    vec3 vel = particle_vel(index);
+    ivec3 base_coord = get_grid_coord(pos, ivec3(0));
     uint grid_index = get_grid_index(base_coord);
     p2g_transfer[grid_index].is_fluid = true; // does not need to be atomic
 
-    scatter_vel(index, ivec3(1, 0, 0));
-    scatter_vel(index, ivec3(0, 1, 0));
-    scatter_vel(index, ivec3(0, 0, 1));
+    scatter_vel(pos, vel, ivec3(1, 0, 0));
+    scatter_vel(pos, vel, ivec3(0, 1, 0));
+    scatter_vel(pos, vel, ivec3(0, 0, 1));
 }
@@ -0,0 +1,68 @@
+// Atomic-free alternative to p2g_accumulate + p2g_apply: every grid cell sums
+// the contributions of the particles in the surrounding cells, found through the
+// cell ranges of a fresh particle sort. Weights and clamping are the same as in
+// p2g_accumulate's scatter_vel; the summation order is fixed by the sort, so
+// the result is deterministic.
+
+// weight along one axis of the corners at base and base + 1 that land on cell
+float gather_weight(int base, float wgt, int cell, int axis) {
+    float weight = 0;
+    if (clamp(base, 0, grid_cell_dim[axis] - 1) == cell)
+        weight += wgt;
+    if (clamp(base + 1, 0, grid_dim[axis] - 1) == cell)
+        weight += 1 - wgt;
+    return weight;
+}
+
+float gather_weight(vec3 pos, ivec3 component, ivec3 grid_pos) {
+    ivec3 base_coord = get_grid_coord(pos, -component);
+    vec3 wgt = (pos - get_world_coord(base_coord, component)) / cell_size;
+    return gather_weight(base_coord.x, wgt.x, grid_pos.x, 0)
+         * gather_weight(base_coord.y, wgt.y, grid_pos.y, 1)
+         * gather_weight(base_coord.z, wgt.z, grid_pos.z, 2);
+}
+
+void main() {
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    vec3 sum = vec3(0);
+    vec3 weight_sum = vec3(0);
+    ivec3 lo = max(grid_pos - ivec3(1), ivec3(0));
+    ivec3 hi = min(grid_pos + ivec3(1), grid_cell_dim - ivec3(1));
+    for (int z = lo.z; z <= hi.z; ++z) {
+        for (int y = lo.y; y <= hi.y; ++y) {
+            for (int x = lo.x; x <= hi.x; ++x) {
+                CellRange range = cell_range[get_grid_index(ivec3(x, y, z))];
+                for (uint i = range.start; i < range.start + range.count; ++i) {
+                    vec3 pos = particle_pos(i);
+                    vec3 vel = particle_vel(i);
+                    // like scatter_part, components with zero velocity add no weight
+                    if (vel.x != 0) {
+                        float weight = gather_weight(pos, ivec3(1, 0, 0), grid_pos);
+                        sum.x += vel.x * weight;
+                        weight_sum.x += weight;
+                    }
+                    if (vel.y != 0) {
+                        float weight = gather_weight(pos, ivec3(0, 1, 0), grid_pos);
+                        sum.y += vel.y * weight;
+                        weight_sum.y += weight;
+                    }
+                    if (vel.z != 0) {
+                        float weight = gather_weight(pos, ivec3(0, 0, 1), grid_pos);
+                        sum.z += vel.z * weight;
+                        weight_sum.z += weight;
+                    }
+                }
+            }
+        }
+    }
+
+    // same as reset_grid followed by p2g_apply
+    cell_flags[index].type = cell_range[index].count > 0 ? FLUID : AIR;
+    cell_vel[index] = vec3(weight_sum.x != 0 ? sum.x / weight_sum.x : 0,
+                           weight_sum.y != 0 ? sum.y / weight_sum.y : 0,
+                           weight_sum.z != 0 ? sum.z / weight_sum.z : 0);
+}
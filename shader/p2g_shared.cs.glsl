@@ -0,0 +1,95 @@
+// Particle to grid transfer privatized per workgroup: each workgroup takes the
+// particles of one tile of cells (through the cell ranges of a fresh particle
+// sort), accumulates them into shared memory covering the tile and its halo,
+// and then adds the tile to p2g_transfer with one global atomic per value,
+// instead of one per particle corner. Followed by p2g_apply as usual.
+// Weights and clamping are the same as in p2g_accumulate.
+
+shared AtomicFloatType tile_u[TILE_HALO_SIZE];
+shared AtomicFloatType tile_v[TILE_HALO_SIZE];
+shared AtomicFloatType tile_w[TILE_HALO_SIZE];
+shared AtomicFloatType tile_weight_u[TILE_HALO_SIZE];
+shared AtomicFloatType tile_weight_v[TILE_HALO_SIZE];
+shared AtomicFloatType tile_weight_w[TILE_HALO_SIZE];
+
+void scatter_part(ivec3 coord, vec3 weights, vec3 vel) {
+    int t = tile_index(coord);
+    float weight = weights.x * weights.y * weights.z;
+    if (vel.x != 0) {
+        atomicAddFloat(tile_u[t], vel.x * weight);
+        atomicAddFloat(tile_weight_u[t], weight);
+    }
+    if (vel.y != 0) {
+        atomicAddFloat(tile_v[t], vel.y * weight);
+        atomicAddFloat(tile_weight_v[t], weight);
+    }
+    if (vel.z != 0) {
+        atomicAddFloat(tile_w[t], vel.z * weight);
+        atomicAddFloat(tile_weight_w[t], weight);
+    }
+}
+
+void scatter_vel(vec3 pos, vec3 vel, ivec3 component) {
+    ivec3 offset =  component;
+    ivec3 base_coord = get_grid_coord(pos, -offset);
+
+    // interpolation weights
+    vec3 wgt = (pos - get_world_coord(base_coord, offset)) / cell_size;
+
+    vec3 comp_vel = vec3(component) * vel;
+    scatter_part(offset_clamped(base_coord, ivec3(0, 0, 0)), vec3(wgt.x, wgt.y, wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(1, 0, 0)), vec3(1-wgt.x, wgt.y, wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(0, 1, 0)), vec3(wgt.x, 1-wgt.y, wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(0, 0, 1)), vec3(wgt.x, wgt.y, 1-wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(1, 1, 0)), vec3(1-wgt.x, 1-wgt.y, wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(0, 1, 1)), vec3(wgt.x, 1-wgt.y, 1-wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(1, 0, 1)), vec3(1-wgt.x, wgt.y, 1-wgt.z), comp_vel);
+    scatter_part(offset_clamped(base_coord, ivec3(1, 1, 1)), vec3(1-wgt.x, 1-wgt.y, 1-wgt.z), comp_vel);
+}
+
+void main() {
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        tile_u[i] = 0;
+        tile_v[i] = 0;
+        tile_w[i] = 0;
+        tile_weight_u[i] = 0;
+        tile_weight_v[i] = 0;
+        tile_weight_w[i] = 0;
+    }
+    barrier();
+
+    // particles only occupy the cells, not the last layer of grid positions
+    ivec3 grid_pos = tile_cell();
+    if (all(lessThan(grid_pos, grid_cell_dim))) {
+        CellRange range = cell_range[get_grid_index(grid_pos)];
+        if (range.count > 0)
+            p2g_transfer[get_grid_index(grid_pos)].is_fluid = true;
+        for (uint i = range.start; i < range.start + range.count; ++i) {
+            vec3 pos = particle_pos(i);
+            vec3 vel = particle_vel(i);
+            scatter_vel(pos, vel, ivec3(1, 0, 0));
+            scatter_vel(pos, vel, ivec3(0, 1, 0));
+            scatter_vel(pos, vel, ivec3(0, 0, 1));
+        }
+    }
+    barrier();
+
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        if (!in_grid(pos))
+            continue;
+        uint index = get_grid_index(pos);
+        if (getAtomicFloat(tile_weight_u[i]) != 0) {
+            atomicAddFloat(p2g_transfer[index].u, getAtomicFloat(tile_u[i]));
+            atomicAddFloat(p2g_transfer[index].weight_u, getAtomicFloat(tile_weight_u[i]));
+        }
+        if (getAtomicFloat(tile_weight_v[i]) != 0) {
+            atomicAddFloat(p2g_transfer[index].v, getAtomicFloat(tile_v[i]));
+            atomicAddFloat(p2g_transfer[index].weight_v, getAtomicFloat(tile_weight_v[i]));
+        }
+        if (getAtomicFloat(tile_weight_w[i]) != 0) {
+            atomicAddFloat(p2g_transfer[index].w, getAtomicFloat(tile_w[i]));
+            atomicAddFloat(p2g_transfer[index].weight_w, getAtomicFloat(tile_weight_w[i]));
+        }
+    }
+}
@@ -0,0 +1,9 @@
+// Workgroup layout for particle kernels: PARTICLE_GROUP_SIZE particles per
+// workgroup, one per invocation, defined by the host when the shader is
+// compiled (see Fluid::particle_kernel).
+
+#ifndef PARTICLE_GROUP_SIZE
+#define PARTICLE_GROUP_SIZE 256
+#endif
+
+layout(local_size_x = PARTICLE_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
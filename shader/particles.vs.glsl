@@ -1,7 +1,12 @@
 layout(location=0) in vec2 circle_offset;
-layout(location=1) in vec3 particle_pos;
-layout(location=2) in vec3 vel;
-layout(location=3) in vec4 particle_color;
+#ifdef COMPACT_PARTICLES
+// decoded from the particle buffer instead of instanced attributes
+uniform vec4 palette[16];
+#else
+layout(location=1) in vec3 instance_pos;
+layout(location=2) in vec3 instance_vel;
+layout(location=3) in vec4 instance_color;
+#endif
 out vec4 color;
 out vec3 vs_particle_pos;
 out float vs_particle_radius;
@@ -12,11 +17,26 @@ uniform mat4 view;
 const int display_mode = 0;
 
 void main() {
+    // the buffer holds more particles than are in use with narrow band FLIP
+    if (gl_InstanceID >= int(particle_count())) {
+        gl_Position = vec4(0, 0, 2, 1);
+        return;
+    }
+#ifdef COMPACT_PARTICLES
+    uint index = uint(gl_InstanceID);
+    vec3 pos = particle_pos(index);
+    vec3 vel = particle_vel(index);
+    vec4 particle_color = palette[particle[index].cell_palette >> 28];
+#else
+    vec3 pos = instance_pos;
+    vec3 vel = instance_vel;
+    vec4 particle_color = instance_color;
+#endif
     float radius = 0.02;
-    vs_particle_pos = particle_pos;
+    vs_particle_pos = pos;
     vs_particle_radius = radius;
 
-    vec3 particle_pos_view = (view * vec4(particle_pos, 1.0)).xyz;
+    vec3 particle_pos_view = (view * vec4(pos, 1.0)).xyz;
     vec3 vertex_pos_view = particle_pos_view + vec3(circle_offset, 0) * radius;
     gl_Position = projection * vec4(vertex_pos_view, 1.0);
     if (display_mode == 0) {
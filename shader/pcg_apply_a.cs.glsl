@@ -0,0 +1,19 @@
+// out = Ax, or out = rhs - Ax for the initial residual
+
+uniform int x_offset;
+uniform int out_offset;
+uniform bool residual;
+
+void main() {
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        float result = 0;
+        if (is_unknown(index)) {
+            float diag, off_sum;
+            level_row(level_coord(index), index, x_offset, diag, off_sum);
+            result = diag * solver_data[x_offset + index] + off_sum;
+            if (residual)
+                result = cell_pressure[index].rhs - result;
+        }
+        solver_data[out_offset + index] = result;
+    }
+}
@@ -0,0 +1,90 @@
+// storage and operators shared by the conjugate gradient and multigrid pressure solver kernels
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding=4) restrict buffer SolverBlock {
+    float solver_data[]; // vectors of every level, at the offsets passed as uniforms
+};
+
+layout(std430, binding=5) restrict buffer SolverTypeBlock {
+    int solver_type[]; // cell types of every level; only FLUID cells are unknowns
+};
+
+layout(std430, binding=6) restrict buffer SolverScalarBlock {
+    float solver_scalar[]; // SCALAR_* slots, followed by per-workgroup partial sums
+};
+
+const int SCALAR_RHO = 0; // two slots, z.r of the current and previous iteration
+const int SCALAR_SQ = 2; // s.As
+const int SCALAR_RESIDUAL = 3; // max |r|
+const int SCALAR_THRESHOLD = 4; // tolerance * max |rhs|; the solve has converged once max |r| is below
+const int SCALAR_ITERATIONS = 5; // iterations taken, counted on the GPU
+const int SCALAR_PARTIALS = 8;
+const int MAX_PARTIALS = 1024;
+
+uniform int level; // multigrid level, 0 is the simulation grid
+uniform ivec3 level_dim; // dimensions of that level
+uniform int type_offset; // start of the level in solver_type
+uniform vec3 level_scale; // off-diagonal magnitude of a coarse level's operator along each axis
+
+int level_size() {
+    return level_dim.x * level_dim.y * level_dim.z;
+}
+
+ivec3 level_coord(int index) {
+    return ivec3(index % level_dim.x, (index / level_dim.x) % level_dim.y, index / (level_dim.x * level_dim.y));
+}
+
+int level_index(ivec3 coord) {
+    return coord.z * level_dim.y * level_dim.x + coord.y * level_dim.x + coord.x;
+}
+
+bool converged() {
+    return solver_scalar[SCALAR_RESIDUAL] <= solver_scalar[SCALAR_THRESHOLD];
+}
+
+bool is_unknown(int index) {
+    return solver_type[type_offset + index] == FLUID;
+}
+
+/**
+ * Diagonal and sum of off-diagonal terms times x of one row of the level's operator.
+ *
+ * Level 0 uses the coefficients from build_a (same neighbor terms as jacobi_iterate).
+ * Coarser levels are built from their cell types alone: a Laplacian with an
+ * empty cell as a zero pressure boundary and a solid cell as a wall.
+ */
+void level_row(ivec3 c, int index, int x_offset, out float diag, out float off_sum) {
+    off_sum = 0;
+    if (level == 0) {
+        diag = cell_a[index].a_diag;
+        if (c.x > 0)
+            off_sum += cell_a[index - 1].a_x * solver_data[x_offset + index - 1];
+        if (c.y > 0)
+            off_sum += cell_a[index - level_dim.x].a_y * solver_data[x_offset + index - level_dim.x];
+        if (c.z > 0)
+            off_sum += cell_a[index - level_dim.x * level_dim.y].a_z * solver_data[x_offset + index - level_dim.x * level_dim.y];
+        if (c.x < level_dim.x - 2)
+            off_sum += cell_a[index].a_x * solver_data[x_offset + index + 1];
+        if (c.y < level_dim.y - 2)
+            off_sum += cell_a[index].a_y * solver_data[x_offset + index + level_dim.x];
+        if (c.z < level_dim.z - 2)
+            off_sum += cell_a[index].a_z * solver_data[x_offset + index + level_dim.x * level_dim.y];
+        return;
+    }
+
+    diag = 0;
+    const ivec3 offsets[6] = ivec3[](ivec3(-1, 0, 0), ivec3(1, 0, 0), ivec3(0, -1, 0), ivec3(0, 1, 0), ivec3(0, 0, -1), ivec3(0, 0, 1));
+    for (int k = 0; k < 6; ++k) {
+        ivec3 n = c + offsets[k];
+        if (any(lessThan(n, ivec3(0))) || any(greaterThanEqual(n, level_dim)))
+            continue;
+        int j = level_index(n);
+        int type = solver_type[type_offset + j];
+        if (type == SOLID || (type == AIR && k % 2 == 0))
+            continue; // like build_a, empty cells only count in the + directions
+        diag += level_scale[k / 2];
+        if (type == FLUID)
+            off_sum -= level_scale[k / 2] * solver_data[x_offset + j];
+    }
+}
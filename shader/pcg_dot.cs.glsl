@@ -0,0 +1,27 @@
+// per-workgroup partial dot product of two vectors, or max norm of the first, finished by pcg_reduce
+
+uniform int a_offset;
+uniform int b_offset;
+uniform bool max_norm;
+
+shared float partial[gl_WorkGroupSize.x];
+
+void main() {
+    float sum = 0;
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        if (max_norm)
+            sum = max(sum, abs(solver_data[a_offset + index]));
+        else
+            sum += solver_data[a_offset + index] * solver_data[b_offset + index];
+    }
+
+    uint local = gl_LocalInvocationID.x;
+    partial[local] = sum;
+    for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride /= 2) {
+        barrier();
+        if (local < stride)
+            partial[local] = max_norm ? max(partial[local], partial[local + stride]) : partial[local] + partial[local + stride];
+    }
+    if (local == 0)
+        solver_scalar[SCALAR_PARTIALS + gl_WorkGroupID.x] = partial[0];
+}
@@ -0,0 +1,10 @@
+// copy the conjugate gradient iterate x to pressure and pressure_guess
+
+uniform int x_offset;
+
+void main() {
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        cell_pressure[index].pressure = solver_data[x_offset + index];
+        cell_pressure[index].pressure_guess = solver_data[x_offset + index];
+    }
+}
@@ -0,0 +1,11 @@
+// warm start the conjugate gradient iterate x from pressure_guess, and copy the right hand side
+
+uniform int x_offset;
+uniform int b_offset;
+
+void main() {
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        solver_data[x_offset + index] = is_unknown(index) ? cell_pressure[index].pressure_guess : 0;
+        solver_data[b_offset + index] = is_unknown(index) ? cell_pressure[index].rhs : 0;
+    }
+}
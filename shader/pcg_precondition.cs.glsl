@@ -0,0 +1,16 @@
+// z = r, or z = r / diag(A) for the Jacobi preconditioner
+
+uniform int r_offset;
+uniform int z_offset;
+uniform bool diagonal;
+
+void main() {
+    if (converged())
+        return;
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        float z = 0;
+        if (is_unknown(index))
+            z = diagonal ? solver_data[r_offset + index] / cell_a[index].a_diag : solver_data[r_offset + index];
+        solver_data[z_offset + index] = z;
+    }
+}
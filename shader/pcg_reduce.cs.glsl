@@ -0,0 +1,25 @@
+// combine the partials written by pcg_dot into one scalar slot (dispatched as a single workgroup)
+
+uniform int num_partials;
+uniform int slot;
+uniform bool max_norm;
+uniform float scale; // applied to the result
+
+shared float partial[gl_WorkGroupSize.x];
+
+void main() {
+    uint local = gl_LocalInvocationID.x;
+    float sum = 0;
+    for (uint i = local; i < num_partials; i += gl_WorkGroupSize.x) {
+        sum = max_norm ? max(sum, solver_scalar[SCALAR_PARTIALS + i]) : sum + solver_scalar[SCALAR_PARTIALS + i];
+    }
+
+    partial[local] = sum;
+    for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride /= 2) {
+        barrier();
+        if (local < stride)
+            partial[local] = max_norm ? max(partial[local], partial[local + stride]) : partial[local] + partial[local + stride];
+    }
+    if (local == 0)
+        solver_scalar[slot] = partial[0] * scale;
+}
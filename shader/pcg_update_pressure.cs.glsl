@@ -0,0 +1,22 @@
+// x += alpha s, r -= alpha As, with alpha = rho / s.As read from the scalar slots;
+// a no-op once converged, so iterations queued before the host notices cost little
+
+uniform int x_offset;
+uniform int r_offset;
+uniform int s_offset;
+uniform int q_offset; // As
+uniform int rho_slot;
+
+void main() {
+    if (converged())
+        return;
+    if (gl_GlobalInvocationID.x == 0)
+        solver_scalar[SCALAR_ITERATIONS] += 1;
+
+    float s_dot_q = solver_scalar[SCALAR_SQ];
+    float alpha = s_dot_q != 0 ? solver_scalar[rho_slot] / s_dot_q : 0;
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        solver_data[x_offset + index] += alpha * solver_data[s_offset + index];
+        solver_data[r_offset + index] -= alpha * solver_data[q_offset + index];
+    }
+}
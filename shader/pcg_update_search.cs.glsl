@@ -0,0 +1,17 @@
+// s = z + beta s, with beta = rho / rho_previous read from the scalar slots
+
+uniform int s_offset;
+uniform int z_offset;
+uniform int rho_slot;
+uniform int previous_rho_slot; // -1 on the first iteration (beta = 0)
+
+void main() {
+    if (converged())
+        return;
+    float beta = 0;
+    if (previous_rho_slot >= 0 && solver_scalar[previous_rho_slot] != 0)
+        beta = solver_scalar[rho_slot] / solver_scalar[previous_rho_slot];
+    for (int index = int(gl_GlobalInvocationID.x); index < level_size(); index += int(gl_NumWorkGroups.x * gl_WorkGroupSize.x)) {
+        solver_data[s_offset + index] = is_unknown(index) ? solver_data[z_offset + index] + beta * solver_data[s_offset + index] : 0;
+    }
+}
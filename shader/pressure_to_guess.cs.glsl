@@ -1,8 +1,8 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
 void main() {
-    ivec3 grid_pos = ivec3(gl_WorkGroupID);
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
     uint index = get_grid_index(grid_pos);
 
-    cell[index].pressure_guess = cell[index].pressure;
+    cell_pressure[index].pressure_guess = cell_pressure[index].pressure;
 }
@@ -1,55 +1,72 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
 uniform float dt;
 
+// type and pressure of the tile and its halo
+shared int tile_type[TILE_HALO_SIZE];
+shared float tile_pressure[TILE_HALO_SIZE];
+
 void main() {
-    ivec3 grid_pos = ivec3(gl_WorkGroupID);
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        tile_type[i] = SOLID;
+        tile_pressure[i] = 0;
+        if (in_grid(pos)) {
+            uint j = get_grid_index(pos);
+            tile_type[i] = cell_flags[j].type;
+            tile_pressure[i] = cell_pressure[j].pressure;
+        }
+    }
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
     uint index = get_grid_index(grid_pos);
+    int t = tile_index(grid_pos);
 
-    // TODO: will break for non-square grids
-    float scale = dt / (density * cell_size.x);
+    // pressure gradient along each axis over that axis's cell size
+    vec3 scale = dt / (density * cell_size);
 
-    if (cell[index].type == FLUID || cell[get_grid_index(grid_pos + ivec3(-1, 0, 0))].type == FLUID) {
+    if (tile_type[t] == FLUID || tile_type[tile_index(grid_pos + ivec3(-1, 0, 0))] == FLUID) {
         // check solid
         if (grid_pos.x == 0 || grid_pos.x == grid_dim.x - 1) {
-            cell[index].vel.x = 0;
+            cell_vel[index].x = 0;
         } else {
-            cell[index].vel.x -= scale * (cell[index].pressure - cell[get_grid_index(grid_pos + ivec3(-1, 0, 0))].pressure);
+            cell_vel[index].x -= scale.x * (tile_pressure[t] - tile_pressure[tile_index(grid_pos + ivec3(-1, 0, 0))]);
         }
     } else {
-        cell[index].vel_unknown = 1;
+        cell_flags[index].vel_unknown = 1;
     }
 
-    if (cell[index].type == FLUID || cell[get_grid_index(grid_pos + ivec3(0, -1, 0))].type == FLUID) {
+    if (tile_type[t] == FLUID || tile_type[tile_index(grid_pos + ivec3(0, -1, 0))] == FLUID) {
         // check solid
         if (grid_pos.y == 0 || grid_pos.y == grid_dim.y - 1) {
-            cell[index].vel.y = 0;
+            cell_vel[index].y = 0;
         } else {
-            cell[index].vel.y -= scale * (cell[index].pressure - cell[get_grid_index(grid_pos + ivec3(0, -1, 0))].pressure);
+            cell_vel[index].y -= scale.y * (tile_pressure[t] - tile_pressure[tile_index(grid_pos + ivec3(0, -1, 0))]);
         }
     } else {
-        cell[index].vel_unknown = 1;
+        cell_flags[index].vel_unknown = 1;
     }
 
-    if (cell[index].type == FLUID || cell[get_grid_index(grid_pos + ivec3(0, 0, -1))].type == FLUID) {
+    if (tile_type[t] == FLUID || tile_type[tile_index(grid_pos + ivec3(0, 0, -1))] == FLUID) {
         // check solid
         if (grid_pos.z == 0 || grid_pos.z == grid_dim.z - 1) {
-            cell[index].vel.z = 0;
+            cell_vel[index].z = 0;
         } else {
-            cell[index].vel.z -= scale * (cell[index].pressure - cell[get_grid_index(grid_pos + ivec3(0, 0, -1))].pressure);
+            cell_vel[index].z -= scale.z * (tile_pressure[t] - tile_pressure[tile_index(grid_pos + ivec3(0, 0, -1))]);
         }
     } else {
-        cell[index].vel_unknown = 1;
+        cell_flags[index].vel_unknown = 1;
     }
 
     // hack to tempfix bug for demo
     if (grid_pos.x == grid_dim.x - 1) {
-        cell[index].vel.x = cell[get_grid_index(grid_pos + ivec3(-1, 0, 0))].vel.x;
+        cell_vel[index].x = cell_vel[get_grid_index(grid_pos + ivec3(-1, 0, 0))].x;
     }
     if (grid_pos.y == grid_dim.y - 1) {
-        cell[index].vel.y = cell[get_grid_index(grid_pos + ivec3(0, -1, 0))].vel.y;
+        cell_vel[index].y = cell_vel[get_grid_index(grid_pos + ivec3(0, -1, 0))].y;
     }
     if (grid_pos.z == grid_dim.z - 1) {
-        cell[index].vel.z = cell[get_grid_index(grid_pos + ivec3(0, 0, -1))].vel.z;
+        cell_vel[index].z = cell_vel[get_grid_index(grid_pos + ivec3(0, 0, -1))].z;
     }
 }
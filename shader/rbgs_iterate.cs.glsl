@@ -0,0 +1,63 @@
+// one red-black Gauss-Seidel half sweep, with successive over-relaxation factor omega
+//
+// Updates pressure_guess in place, so no copy is needed between iterations, and
+// mirrors it into pressure. Dispatched over (ceil(grid_dim.x / 2), grid_dim.y,
+// grid_dim.z) invocations: every invocation handles the cell of its pair of
+// cells along x with the current color. With SPARSE_GRID or INDIRECT_DISPATCH
+// the dispatch covers every cell of the active tiles and the cells of the
+// other color return.
+
+uniform int color; // parity of x + y + z of the cells updated
+uniform float omega;
+
+void main() {
+#if defined(SPARSE_GRID) || defined(INDIRECT_DISPATCH)
+    ivec3 grid_pos = tile_cell();
+    if (((grid_pos.x + grid_pos.y + grid_pos.z) & 1) != color)
+        return;
+#else
+    ivec3 grid_pos = ivec3(gl_GlobalInvocationID);
+    grid_pos.x = 2 * grid_pos.x + ((grid_pos.y + grid_pos.z + color) & 1);
+#endif
+    if (!in_grid(grid_pos))
+        return;
+    uint index = get_grid_index(grid_pos);
+
+    if (cell_flags[index].type != FLUID || cell_a[index].a_diag == 0) {
+        // pressure was cleared by build_a
+        return;
+    }
+
+    float L_Up = 0;
+
+    if (grid_pos.x > 0) {
+        uint j = get_grid_index(grid_pos + ivec3(-1, 0, 0));
+        L_Up += cell_a[j].a_x * cell_pressure[j].pressure_guess;
+    }
+    if (grid_pos.y > 0) {
+        uint j = get_grid_index(grid_pos + ivec3(0, -1, 0));
+        L_Up += cell_a[j].a_y * cell_pressure[j].pressure_guess;
+    }
+    if (grid_pos.z > 0) {
+        uint j = get_grid_index(grid_pos + ivec3(0, 0, -1));
+        L_Up += cell_a[j].a_z * cell_pressure[j].pressure_guess;
+    }
+
+    if (grid_pos.x < grid_dim.x - 2) {
+        uint j = get_grid_index(grid_pos + ivec3(1, 0, 0));
+        L_Up += cell_a[index].a_x * cell_pressure[j].pressure_guess;
+    }
+    if (grid_pos.y < grid_dim.y - 2) {
+        uint j = get_grid_index(grid_pos + ivec3(0, 1, 0));
+        L_Up += cell_a[index].a_y * cell_pressure[j].pressure_guess;
+    }
+    if (grid_pos.z < grid_dim.z - 2) {
+        uint j = get_grid_index(grid_pos + ivec3(0, 0, 1));
+        L_Up += cell_a[index].a_z * cell_pressure[j].pressure_guess;
+    }
+
+    float gauss_seidel = 1.0 / cell_a[index].a_diag * (cell_pressure[index].rhs - L_Up);
+    float pressure = mix(cell_pressure[index].pressure_guess, gauss_seidel, omega);
+    cell_pressure[index].pressure_guess = pressure;
+    cell_pressure[index].pressure = pressure;
+}
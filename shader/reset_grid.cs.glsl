@@ -1,8 +1,8 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
 void main() {
-    ivec3 grid_pos = ivec3(gl_WorkGroupID);
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
     uint index = get_grid_index(grid_pos);
-    cell[index].type = AIR;
-    cell[index].vel = vec3(0);
+    cell_flags[index].type = AIR;
+    cell_vel[index] = vec3(0);
 }
@@ -1,11 +1,28 @@
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
 uniform float dt;
 
-void compute_divergence();
-void build_a();
+// velocity and type of the tile and its halo, read by compute_divergence and build_a
+shared vec3 tile_vel[TILE_HALO_SIZE];
+shared int tile_type[TILE_HALO_SIZE];
+
+void compute_divergence(ivec3 grid_pos);
+void build_a(ivec3 grid_pos);
 
 void main() {
-    compute_divergence();
-    build_a();
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_HALO_SIZE; i += TILE_SIZE) {
+        ivec3 pos = tile_halo_pos(i);
+        tile_vel[i] = vec3(0);
+        tile_type[i] = SOLID;
+        if (in_grid(pos)) {
+            uint j = get_grid_index(pos);
+            tile_vel[i] = cell_vel[j];
+            tile_type[i] = cell_flags[j].type;
+        }
+    }
+    barrier();
+
+    ivec3 grid_pos = tile_cell();
+    if (!in_grid(grid_pos))
+        return;
+    compute_divergence(grid_pos);
+    build_a(grid_pos);
 }
@@ -0,0 +1,27 @@
+// order the particles within each cell by id, since the atomic slots handed out
+// by sort_histogram depend on scheduling; this makes the sorted order deterministic
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+    uint cell = gl_GlobalInvocationID.x;
+    if (cell >= num_cells()) {
+        return;
+    }
+
+    uint begin = cell_range[cell].start;
+    uint end = begin + cell_range[cell].count;
+    if (cell == num_cells() - 1u) {
+        // culled particles aren't in any cell, the rest now come first
+        num_particles = end;
+    }
+    for (uint i = begin + 1; i < end; ++i) {
+        Particle p = sorted_particle[i];
+        uint j = i;
+        while (j > begin && sorted_particle[j - 1].id > p.id) {
+            sorted_particle[j] = sorted_particle[j - 1];
+            --j;
+        }
+        sorted_particle[j] = p;
+    }
+}
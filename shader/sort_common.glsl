@@ -0,0 +1,41 @@
+// storage shared by the particle sort kernels (see ParticleSort)
+
+struct CellRange {
+    uint start; // index of the cell's first particle in the sorted buffer
+    uint count;
+};
+
+layout(std430, binding=8) restrict buffer CellRangeBlock {
+    CellRange cell_range[]; // one per grid cell, valid after a sort until particles move
+};
+
+const int MAX_SORT_GROUPS = 1024;
+
+layout(std430, binding=9) restrict buffer SortScratchBlock {
+    uint sort_partial[MAX_SORT_GROUPS]; // particle count of each scan workgroup's chunk of cells
+    uint sort_rank[]; // index of each particle among the particles of its cell
+};
+
+layout(std430, binding=10) restrict buffer SortedParticleBlock {
+    Particle sorted_particle[];
+};
+
+uint num_cells() {
+    return uint(grid_dim.x * grid_dim.y * grid_dim.z);
+}
+
+#ifdef NARROW_BAND
+// particles deeper below the surface than the band are dropped by the sort
+bool particle_culled(uint key) {
+    return cell_band[key].depth > float(NARROW_BAND);
+}
+#else
+bool particle_culled(uint key) {
+    return false;
+}
+#endif
+
+// sort key: index of the grid cell containing pos
+uint particle_cell(vec3 pos) {
+    return uint(get_grid_index(clamp(get_grid_coord(pos, ivec3(0)), ivec3(0), grid_dim - ivec3(1))));
+}
@@ -0,0 +1,13 @@
+// count particles per cell, remembering each particle's slot within its cell
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= particle_count()) {
+        return;
+    }
+
+    uint key = particle_cell(particle_pos(index));
+    if (particle_culled(key))
+        return;
+    sort_rank[index] = atomicAdd(cell_range[key].count, 1);
+}
@@ -0,0 +1,14 @@
+void main() {
+    uint begin = gl_WorkGroupID.x * chunk_size();
+    uint end = min(begin + chunk_size(), num_cells());
+    uint carry = sort_partial[gl_WorkGroupID.x];
+    for (uint tile = begin; tile < end; tile += gl_WorkGroupSize.x) {
+        uint cell = tile + gl_LocalInvocationID.x;
+        uint count = cell < end ? cell_range[cell].count : 0;
+        uint inclusive = workgroup_scan(count);
+        if (cell < end)
+            cell_range[cell].start = carry + inclusive - count;
+        carry += scan_tile[gl_WorkGroupSize.x - 1];
+        barrier();
+    }
+}
@@ -0,0 +1,26 @@
+// exclusive scan of cell counts into cell starts, in three passes:
+// sort_scan_partials sums the counts of each workgroup's chunk of cells,
+// sort_scan_groups scans those sums, and sort_scan_cells scans within each chunk
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+shared uint scan_tile[gl_WorkGroupSize.x];
+
+// chunk of cells scanned by this workgroup; the dispatch has at most MAX_SORT_GROUPS groups
+uint chunk_size() {
+    return (num_cells() + gl_NumWorkGroups.x - 1) / gl_NumWorkGroups.x;
+}
+
+// inclusive scan of value across the workgroup
+uint workgroup_scan(uint value) {
+    uint local = gl_LocalInvocationID.x;
+    scan_tile[local] = value;
+    for (uint stride = 1; stride < gl_WorkGroupSize.x; stride *= 2) {
+        barrier();
+        uint other = local >= stride ? scan_tile[local - stride] : 0;
+        barrier();
+        scan_tile[local] += other;
+    }
+    barrier();
+    return scan_tile[local];
+}
@@ -0,0 +1,16 @@
+// single workgroup; turns the chunk sums into exclusive chunk offsets
+
+uniform uint num_partials;
+
+void main() {
+    uint carry = 0;
+    for (uint tile = 0; tile < num_partials; tile += gl_WorkGroupSize.x) {
+        uint index = tile + gl_LocalInvocationID.x;
+        uint value = index < num_partials ? sort_partial[index] : 0;
+        uint inclusive = workgroup_scan(value);
+        if (index < num_partials)
+            sort_partial[index] = carry + inclusive - value;
+        carry += scan_tile[gl_WorkGroupSize.x - 1];
+        barrier();
+    }
+}
@@ -0,0 +1,12 @@
+void main() {
+    uint begin = gl_WorkGroupID.x * chunk_size();
+    uint end = min(begin + chunk_size(), num_cells());
+    uint sum = 0;
+    for (uint cell = begin + gl_LocalInvocationID.x; cell < end; cell += gl_WorkGroupSize.x) {
+        sum += cell_range[cell].count;
+    }
+
+    uint total = workgroup_scan(sum);
+    if (gl_LocalInvocationID.x == gl_WorkGroupSize.x - 1)
+        sort_partial[gl_WorkGroupID.x] = total;
+}
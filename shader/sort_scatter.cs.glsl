@@ -0,0 +1,13 @@
+// move each particle to its slot in the sorted buffer
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= particle_count()) {
+        return;
+    }
+
+    uint key = particle_cell(particle_pos(index));
+    if (particle_culled(key))
+        return;
+    sorted_particle[cell_range[key].start + sort_rank[index]] = particle[index];
+}
@@ -12,11 +12,11 @@ struct Box {
     gfx::VAO vao;
     gfx::Program program;
 
-    Box() {
+    Box(const glm::vec3& lo = glm::vec3(-1), const glm::vec3& hi = glm::vec3(1)) {
         const std::vector<glm::vec3> data{
-            glm::vec3(-1.f, -1.f, -1.f), glm::vec3(1.0f, -1.f, -1.f), glm::vec3(1.0f, -1.f, 1.0f), 
-            glm::vec3(-1.f, -1.f, 1.0f), glm::vec3(-1.f, 1.0f, 1.0f), glm::vec3(-1.f, 1.0f, -1.f),
-            glm::vec3(1.0f, 1.0f, -1.f), glm::vec3(1.0f, 1.0f, 1.0f)
+            glm::vec3(lo.x, lo.y, lo.z), glm::vec3(hi.x, lo.y, lo.z), glm::vec3(hi.x, lo.y, hi.z),
+            glm::vec3(lo.x, lo.y, hi.z), glm::vec3(lo.x, hi.y, hi.z), glm::vec3(lo.x, hi.y, lo.z),
+            glm::vec3(hi.x, hi.y, lo.z), glm::vec3(hi.x, hi.y, hi.z)
         };
         vbo.set_data(data);
         vao.bind_attrib(vbo, 3, GL_FLOAT);
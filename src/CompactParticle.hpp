@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include "Particle.hpp"
+#include "cpu/grid_geometry.hpp"
+
+/**
+ * 20 byte particle for the GPU buffer, matching the COMPACT_PARTICLES Particle
+ * in common.glsl. The position is stored as the index of its grid cell and a
+ * 16-bit fixed point offset within that cell, so precision doesn't depend on
+ * where in the domain the particle is; velocity is half precision; the color is
+ * an index into a small palette instead of a vec4.
+ */
+struct CompactParticle {
+    constexpr static std::uint32_t cell_mask = 0x0fffffffu; // PARTICLE_CELL_MASK in common.glsl
+    constexpr static int palette_size = 16;
+
+    std::uint32_t cell_palette; // grid index of the containing cell in the low 28 bits, palette index in the high 4
+    std::uint32_t pos_xy; // position within the cell, 16-bit fixed point
+    std::uint32_t pos_z_vel_x; // z position within the cell, half precision x velocity
+    std::uint32_t vel_yz; // half precision y and z velocity
+    std::uint32_t id; // stable across reordering of the particle buffer
+
+    CompactParticle(const cpu::GridGeometry& geom, const glm::vec3& pos, const glm::vec3& vel, std::uint32_t palette_index, std::uint32_t id = 0) : id(id) {
+        // same rounding as set_particle_pos_vel in common.glsl
+        const glm::ivec3 coord = glm::clamp(geom.get_grid_coord(pos, glm::ivec3(0)), glm::ivec3(0), geom.grid_cell_dimensions - glm::ivec3(1));
+        const glm::uvec3 fixed_pos = glm::clamp((pos - geom.get_world_coord(coord, glm::ivec3(0))) / geom.cell_size * 65536.f, glm::vec3(0), glm::vec3(65535));
+        cell_palette = (palette_index << 28) | static_cast<std::uint32_t>(geom.get_grid_index(coord));
+        pos_xy = fixed_pos.x | (fixed_pos.y << 16);
+        pos_z_vel_x = fixed_pos.z | (glm::packHalf2x16(glm::vec2(vel.x, 0)) << 16);
+        vel_yz = glm::packHalf2x16(glm::vec2(vel.y, vel.z));
+    }
+
+    glm::vec3 pos(const cpu::GridGeometry& geom) const {
+        const glm::ivec3 coord = geom.get_grid_coord_from_index(cell_palette & cell_mask);
+        const glm::uvec3 fixed_pos{pos_xy & 0xffffu, pos_xy >> 16, pos_z_vel_x & 0xffffu};
+        return geom.get_world_coord(coord, glm::ivec3(0)) + (glm::vec3(fixed_pos) + 0.5f) / 65536.f * geom.cell_size;
+    }
+
+    glm::vec3 vel() const {
+        return {glm::unpackHalf2x16(pos_z_vel_x >> 16).x, glm::unpackHalf2x16(vel_yz)};
+    }
+
+    std::uint32_t palette_index() const {
+        return cell_palette >> 28;
+    }
+};
+
+// particle format of the GPU buffer, chosen at compile time
+#ifdef FLUID_COMPACT_PARTICLES
+using GpuParticle = CompactParticle;
+#else
+using GpuParticle = Particle;
+#endif
@@ -1,4 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
 #include <vector>
 #include <stdexcept>
 #include <glad/glad.h>
@@ -7,45 +12,119 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <glm/gtx/vec_swizzle.hpp>
-#include <eigen3/Eigen/Core>
-#include <eigen3/Eigen/Sparse>
+#include "CompactParticle.hpp"
 #include "GridCell.hpp"
 #include "Particle.hpp"
 #include "DebugLine.hpp"
+#include "FluidConfig.hpp"
+#include "FluidExtent.hpp"
 #include "P2GTransfer.hpp"
 #include "SSFBufferElement.hpp"
 #include "SSFRenderTexture.hpp"
+#include "ParticleSort.hpp"
+#include "SparseGrid.hpp"
+#include "PressureCG.hpp"
 #include "Quad.hpp"
 #include "util.hpp"
 #include "gfx/object.hpp"
 #include "gfx/program.hpp"
 #include "gfx/rendertexture.hpp"
+#include "cpu/eigen_pressure.hpp"
+#include "cpu/jacobi_spectrum.hpp"
+#include "cpu/simulation.hpp"
 
 struct Fluid {
+    enum class Backend {
+        GPU, // compute shaders
+        CPU, // multithreaded host implementation (cpu::Simulation)
+    };
+
+    enum class PressureSolver {
+        JACOBI, // fixed number of Jacobi iterations
+        RED_BLACK_GS, // fixed number of in-place red-black Gauss-Seidel/SOR iterations
+        CHEBYSHEV, // fixed number of Chebyshev-accelerated Jacobi iterations
+        CG, // conjugate gradient with early termination (PressureCG), multigrid preconditioned by default
+    };
+
+    enum class P2GMode {
+        SCATTER, // particles add to the grid with float atomics
+        GATHER, // grid cells sum the particles around them, sorting the particles every step; no atomics, deterministic
+        SHARED, // scatter each tile's particles in workgroup shared memory, sorting the particles every step, then flush once
+    };
+
     const int num_circle_vertices = 16; // circle detail for particle rendering
 
-    const int particle_density = 8;
-    const int grid_size = 24;
-    const glm::ivec3 grid_dimensions{grid_size + 1, grid_size + 1, grid_size + 1};
-    const glm::ivec3 grid_cell_dimensions{grid_size, grid_size, grid_size};
-    const glm::vec3 bounds_min{-1, -1, -1};
-    const glm::vec3 bounds_max{1, 1, 1};
+    const FluidConfig config; // resolved, see FluidConfig::resolve()
+    const int particle_density = config.particle_density; // particles seeded per fluid cell
+    const glm::ivec3 grid_cell_dimensions = config.grid; // number of cells along each axis
+    const glm::ivec3 grid_dimensions = grid_cell_dimensions + glm::ivec3(1);
+    const glm::vec3 bounds_min = config.bounds_min;
+    const glm::vec3 bounds_max = config.bounds_max;
     const glm::vec3 bounds_size = bounds_max - bounds_min;
     const glm::vec3 cell_size = bounds_size / glm::vec3(grid_cell_dimensions);
+    float dt = config.dt; // seconds per step, or per frame with step_frame()
+    float cfl_number = 1; // grid cells the fastest fluid may cross in one step of step_frame()
+    int max_substeps = 8; // step_frame() steps further than cfl_number allows beyond this
+    int substeps = 1; // steps taken by the last step_frame()
+    float substep_dt = config.dt; // time step of the last step_frame()
     const glm::vec3 gravity{0, -9.8, 0};
+    glm::ivec3 grid_tile_size{8, 8, 4}; // workgroup size of grid kernels, compiled into the shaders by init()
+    int particle_group_size = 256; // workgroup size of particle kernels, compiled into the shaders by init()
+    bool fuse_g2p_advect = true; // do grid_to_particle() and particle_advect() in one pass over the particles
     glm::vec3 world_mouse_pos{0, -0.9, 0};
     glm::vec3 world_mouse_vel{0, 0, 0};
-    glm::vec3 look{0, 0, 1};
-    glm::vec3 eye{0, 0, 0};
-    glm::ivec2 resolution{0, 0};
+    glm::vec3 look{0, 0, 1}; // for drawing
+    glm::vec3 eye{0, 0, 0}; // camera position, for the mouse interaction of the simulation
+    glm::ivec2 resolution{0, 0}; // for drawing
     float pic_flip_blend = 0.9;
+    std::vector<glm::vec4> particle_palette{glm::vec4(0.32,0.57,0.79,1.0)}; // particle colors, up to CompactParticle::palette_size
+    PressureSolver pressure_solver = PressureSolver::JACOBI; // for Backend::GPU
+    P2GMode p2g_mode = P2GMode::SCATTER; // for Backend::GPU
+    int pressure_iterations = 40; // for PressureSolver::JACOBI, RED_BLACK_GS and CHEBYSHEV
+    float sor_omega = 1.0; // over-relaxation for PressureSolver::RED_BLACK_GS, 1 for plain Gauss-Seidel
+    int chebyshev_estimate_interval = 10; // steps between spectral radius estimates for CHEBYSHEV, 0 to estimate once
+    float jacobi_radius = -1; // spectral radius estimate of the Jacobi iteration, -1 before the first
+    int steps_since_estimate = 0;
+    int sort_interval = 10; // steps between sorts of the particles by grid cell, 0 to never sort (GATHER and SHARED sort every step)
+    int steps_since_sort = 0;
+    bool sparse_grid = false; // run grid kernels over the bricks around the particles only, compiled into the shaders by init()
+    bool indirect_dispatch = false; // size grid and particle dispatches on the GPU from the fluid's extents, compiled into the shaders by init()
+    bool narrow_band = false; // keep particles only near the surface and carry the interior velocity on the grid, set before init()
+    int narrow_band_width = 3; // cells below the surface that keep particles, for narrow_band
+    GLuint narrow_band_steps = 0; // steps taken with narrow_band, seeds the reseeding jitter
+
+    const Backend backend;
+    const int cpu_threads; // thread count for Backend::CPU, 0 for all hardware threads
+    std::unique_ptr<cpu::ThreadPool> cpu_pool; // workers for CPU code paths, created on first use
+    std::unique_ptr<cpu::Simulation> cpu_sim; // simulation state for Backend::CPU
+    cpu::ParticleToGrid cpu_p2g; // scratch for particle_to_grid_cpu
+    cpu::PressurePCG cpu_pcg; // solver state for pressure_solve_pcg
+    cpu::EigenPressureSolver cpu_eigen; // cached matrix and factorization for pressure_solve_eigen
+    bool cpu_grid_dirty = false; // the grid buffers are stale relative to cpu_sim
+    bool eager_cpu_grid = false; // upload the grid of cpu_sim every step instead of when drawn, when another thread draws
+    PressureCG pressure_cg; // buffers, programs and statistics for PressureSolver::CG
+    ParticleSort particle_sort; // buffers and programs for sort_particles()
+    SparseGrid active_bricks; // buffers and programs for sparse_grid
+    FluidExtent fluid_extent; // particle count, and buffers and programs for indirect_dispatch
 
     gfx::Buffer viewport_rect{GL_ARRAY_BUFFER};
     gfx::Buffer particle_ssbo{GL_SHADER_STORAGE_BUFFER}; // particle data storage
-    gfx::Buffer grid_ssbo{GL_SHADER_STORAGE_BUFFER}; // grid data storage
+    const gfx::Buffer* drawn_particles = &particle_ssbo; // particles the draws read, see set_draw_particles()
+    // grid data storage, one buffer per field group (see GridCell.hpp)
+    gfx::Buffer grid_vel_ssbo{GL_SHADER_STORAGE_BUFFER}; // GridVelocity
+    gfx::Buffer grid_old_vel_ssbo{GL_SHADER_STORAGE_BUFFER}; // GridVelocity, before the pressure projection
+    gfx::Buffer grid_pressure_ssbo{GL_SHADER_STORAGE_BUFFER}; // GridPressure
+    gfx::Buffer grid_coefficient_ssbo{GL_SHADER_STORAGE_BUFFER}; // GridCoefficients
+    gfx::Buffer grid_flag_ssbo{GL_SHADER_STORAGE_BUFFER}; // GridFlags
     gfx::Buffer transfer_ssbo{GL_SHADER_STORAGE_BUFFER}; // p2g transfer storage buffer
     gfx::Buffer circle_verts{GL_ARRAY_BUFFER};
     gfx::Buffer debug_lines_ssbo{GL_SHADER_STORAGE_BUFFER};
+    gfx::Buffer chebyshev_ssbo{GL_SHADER_STORAGE_BUFFER}; // previous iterate of the Chebyshev pressure solve
+    gfx::Buffer max_speed_ssbo{GL_SHADER_STORAGE_BUFFER}; // fastest velocity at the end of the last step_frame()
+    gfx::Buffer max_speed_readback{GL_SHADER_STORAGE_BUFFER}; // copy of max_speed_ssbo, read once max_speed_fence signals
+    GLsync max_speed_fence = nullptr; // signaled when the copy into max_speed_readback is done
+    float max_speed = 0; // last fastest velocity read back, see max_cell_speed()
+    gfx::Buffer grid_band_ssbo{GL_SHADER_STORAGE_BUFFER}; // NarrowBandCell, for narrow_band
     gfx::VAO vao;
     gfx::VAO grid_vao;
     gfx::VAO debug_lines_vao; // used for drawing colored lines for debugging
@@ -54,6 +133,8 @@ struct Fluid {
     gfx::Program reset_grid_program; // clear grid state
     gfx::Program p2g_accumulate_program; // accumulate new grid velocities from particles
     gfx::Program p2g_apply_program; // copy new grid velocities to grid data
+    gfx::Program p2g_gather_program; // grid velocities from the sorted particles, without atomics
+    gfx::Program p2g_shared_program; // accumulate the sorted particles per tile in shared memory
     gfx::Program particle_advect_program; // compute shader to operate on particles SSBO
     gfx::Program body_forces_program; // compute shader to apply body forces on grid
     gfx::Program extrapolate_program; // extrapolate grid velocities by one cell
@@ -61,8 +142,18 @@ struct Fluid {
     gfx::Program setup_grid_project_program; // compute A and RHS of pressure equation
     gfx::Program jacobi_iterate_program; // single jacobi iteration to solve for pressure gradient 
     gfx::Program pressure_to_guess_program; // copy pressure to pressure_guess for pressure solve
+    gfx::Program rbgs_iterate_program; // red-black Gauss-Seidel half sweep, in place
+    gfx::Program chebyshev_iterate_program; // Chebyshev-accelerated Jacobi iteration
+    gfx::Program chebyshev_shift_program; // advance pressure iterates for the Chebyshev solve
     gfx::Program pressure_update_program; // update velocities from pressure gradient
     gfx::Program grid_to_particle_program; // transfer grid velocities to particles
+    gfx::Program g2p_advect_program; // grid_to_particle_program and particle_advect_program in one kernel
+    gfx::Program narrow_band_carry_program; // advect the grid velocity and depth for the interior
+    gfx::Program narrow_band_fill_program; // make the carried interior fluid
+    gfx::Program narrow_band_depth_program; // distance to the surface
+    gfx::Program narrow_band_reseed_program; // seed particles where the band moved into the interior
+    gfx::Program narrow_band_count_program; // clamp the particle count after reseeding
+    gfx::Program max_speed_program; // fastest velocity, for step_frame()
 
     gfx::Program program; // program for particle rendering
     gfx::Program grid_program;
@@ -79,12 +170,100 @@ struct Fluid {
 
     Quad quad;
 
-    Fluid() {}
+    Fluid(const FluidConfig& config, Backend backend = Backend::GPU, int cpu_threads = 0)
+        : config(config.resolve()), backend(backend), cpu_threads(cpu_threads) {}
+
+    ~Fluid() {
+        if (max_speed_fence) {
+            glDeleteSync(max_speed_fence);
+        }
+    }
+
+    // cube of grid_size^3 cells over [-1, 1]^3
+    Fluid(int grid_size = 24, int particle_density = 8, Backend backend = Backend::GPU, int cpu_threads = 0)
+        : Fluid(cube_config(grid_size, particle_density), backend, cpu_threads) {}
+
+    static FluidConfig cube_config(int grid_size, int particle_density) {
+        FluidConfig config;
+        config.grid = glm::ivec3(grid_size);
+        config.particle_density = particle_density;
+        return config;
+    }
 
     void init() {
+        init_simulation();
+        init_rendering();
+    }
+
+    /**
+     * Create the simulation buffers and compute kernels, on the context that
+     * will run step() (see SimulationThread).
+     */
+    void init_simulation() {
+#ifdef FLUID_COMPACT_PARTICLES
+        // selects the Particle layout and accessors of common.glsl in every program
+        const std::string compact_define = "#define COMPACT_PARTICLES\n";
+        if (gfx::shader_prepend.find(compact_define) == std::string::npos) {
+            gfx::shader_prepend += compact_define;
+        }
+        if (glm::compMul(grid_dimensions) > static_cast<int>(CompactParticle::cell_mask) + 1) {
+            throw std::runtime_error("The grid has too many cells for the compact particle format.");
+        }
+#endif
         init_ssbos();
 
-        // graphics initialization
+        grid_kernel(reset_grid_program).compute({"common.glsl", "grid_tile.glsl", "reset_grid.cs.glsl"}).compile();
+        particle_kernel(p2g_accumulate_program).compute({"atomic.glsl", "common.glsl", "p2g_common.glsl", "particle_group.glsl", "p2g_accumulate.cs.glsl"}).compile();
+        grid_kernel(p2g_gather_program).compute({"common.glsl", "sort_common.glsl", "grid_tile.glsl", "p2g_gather.cs.glsl"}).compile();
+        grid_kernel(p2g_shared_program).compute({"atomic.glsl", "common.glsl", "p2g_common.glsl", "sort_common.glsl", "grid_tile.glsl", "p2g_shared.cs.glsl"}).compile();
+        grid_kernel(p2g_apply_program).compute({"atomic.glsl", "common.glsl", "p2g_common.glsl", "grid_tile.glsl", "p2g_apply.cs.glsl"}).compile();
+        particle_kernel(grid_to_particle_program).compute({"common.glsl", "particle_group.glsl", "grid_to_particle.glsl", "grid_to_particle.cs.glsl"}).compile();
+        grid_kernel(extrapolate_program).compute({"common.glsl", "grid_tile.glsl", "extrapolate.cs.glsl"}).compile();
+        grid_kernel(set_vel_known_program).compute({"common.glsl", "grid_tile.glsl", "set_vel_known.cs.glsl"}).compile();
+        grid_kernel(max_speed_program).compute({"common.glsl", "grid_tile.glsl", "max_speed.cs.glsl"}).compile();
+        grid_kernel(body_forces_program).compute({"common.glsl", "grid_tile.glsl", "enforce_boundary.cs.glsl", "body_forces.cs.glsl"}).compile();
+        grid_kernel(setup_grid_project_program).compute({"common.glsl", "grid_tile.glsl", "setup_project.cs.glsl", "compute_divergence.cs.glsl", "build_a.cs.glsl"}).compile();
+        grid_kernel(jacobi_iterate_program).compute({"common.glsl", "grid_tile.glsl", "jacobi_iterate.cs.glsl"}).compile();
+        grid_kernel(pressure_to_guess_program).compute({"common.glsl", "grid_tile.glsl", "pressure_to_guess.cs.glsl"}).compile();
+        grid_kernel(rbgs_iterate_program).compute({"common.glsl", "grid_tile.glsl", "rbgs_iterate.cs.glsl"}).compile();
+        grid_kernel(chebyshev_iterate_program).compute({"common.glsl", "chebyshev_common.glsl", "grid_tile.glsl", "chebyshev_iterate.cs.glsl"}).compile();
+        grid_kernel(chebyshev_shift_program).compute({"common.glsl", "chebyshev_common.glsl", "grid_tile.glsl", "chebyshev_shift.cs.glsl"}).compile();
+        grid_kernel(pressure_update_program).compute({"common.glsl", "grid_tile.glsl", "pressure_update.cs.glsl"}).compile();
+        particle_kernel(particle_advect_program).compute({"common.glsl", "rand.glsl", "particle_group.glsl", "particle_advect.glsl", "particle_advect.cs.glsl"}).compile();
+        particle_kernel(g2p_advect_program).compute({"common.glsl", "rand.glsl", "particle_group.glsl", "grid_to_particle.glsl", "particle_advect.glsl", "g2p_advect.cs.glsl"}).compile();
+        if (narrow_band) {
+            if (sparse_grid or indirect_dispatch) {
+                // the carried interior has no particles for them to find
+                throw std::runtime_error("Narrow band FLIP needs grid kernels over the whole grid.");
+            }
+            const std::string band = std::to_string(narrow_band_width);
+            grid_kernel(narrow_band_carry_program).define("NARROW_BAND", band).compute({"common.glsl", "narrow_band_common.glsl", "grid_tile.glsl", "grid_to_particle.glsl", "narrow_band_carry.cs.glsl"}).compile();
+            grid_kernel(narrow_band_fill_program).define("NARROW_BAND", band).compute({"common.glsl", "narrow_band_common.glsl", "grid_tile.glsl", "narrow_band_fill.cs.glsl"}).compile();
+            grid_kernel(narrow_band_depth_program).define("NARROW_BAND", band).compute({"common.glsl", "narrow_band_common.glsl", "grid_tile.glsl", "narrow_band_depth.cs.glsl"}).compile();
+            grid_kernel(narrow_band_reseed_program).define("NARROW_BAND", band).compute({"common.glsl", "rand.glsl", "narrow_band_common.glsl", "sort_common.glsl", "grid_tile.glsl", "grid_to_particle.glsl", "narrow_band_reseed.cs.glsl"}).compile();
+            narrow_band_count_program.compute({"common.glsl", "narrow_band_count.cs.glsl"}).compile();
+            particle_sort.narrow_band = narrow_band_width;
+        }
+        pressure_cg.init(grid_dimensions, bounds_min, bounds_max);
+        particle_sort.init(grid_dimensions, bounds_min, bounds_max, particle_ssbo.length(), particle_group_size);
+        fluid_extent.init(grid_dimensions, bounds_min, bounds_max, grid_tile_size, particle_ssbo.length(), particle_group_size);
+        if (sparse_grid) {
+            active_bricks.init(grid_dimensions, bounds_min, bounds_max, grid_tile_size, particle_group_size);
+        }
+    }
+
+    /**
+     * Create the drawing buffers and programs, on the context that draws.
+     */
+    void init_rendering() {
+        std::vector<DebugLine> debug_lines;
+        debug_lines.push_back(DebugLine({0, 0, 0}, {0.1, 0, 0}, {1, 0, 0, 1})); // x axis
+        debug_lines.push_back(DebugLine({0, 0, 0}, {0, 0.1, 0}, {0, 1, 0, 1})); // y axis
+        debug_lines.push_back(DebugLine({0, 0, 0}, {0, 0, 0.1}, {0, 0, 1, 1})); // z axis
+        debug_lines_ssbo.bind_base(2).set_data(debug_lines);
+
+        std::cout << "Size of debug lines buffer " << debug_lines_ssbo.length() << " (" << debug_lines_ssbo.size() << " bytes)" << std::endl;
+
         // circle vertices (for triangle fan)
         std::vector<glm::vec2> circle;
         for (int i = 0; i < num_circle_vertices; ++i) {
@@ -93,46 +272,39 @@ struct Fluid {
         }
         circle_verts.set_data(circle);
 
-        vao.bind_attrib(circle_verts, 2, GL_FLOAT)
-           .bind_attrib(particle_ssbo, offsetof(Particle, pos), sizeof(Particle), 3, GL_FLOAT, gfx::INSTANCED)
+        vao.bind_attrib(circle_verts, 2, GL_FLOAT);
+#ifndef FLUID_COMPACT_PARTICLES
+        // compact particles are decoded from the particle buffer in particles.vs.glsl instead
+        vao.bind_attrib(particle_ssbo, offsetof(Particle, pos), sizeof(Particle), 3, GL_FLOAT, gfx::INSTANCED)
            .bind_attrib(particle_ssbo, offsetof(Particle, vel), sizeof(Particle), 3, GL_FLOAT, gfx::INSTANCED)
            .bind_attrib(particle_ssbo, offsetof(Particle, color), sizeof(Particle), 4, GL_FLOAT, gfx::INSTANCED);
+#endif
         
-        grid_vao.bind_attrib(grid_ssbo, offsetof(GridCell, pos), sizeof(GridCell), 3, GL_FLOAT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, vel), sizeof(GridCell), 3, GL_FLOAT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, type), sizeof(GridCell), 1, GL_INT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, rhs), sizeof(GridCell), 1, GL_FLOAT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, a_diag), sizeof(GridCell), 4, GL_FLOAT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, pressure), sizeof(GridCell), 1, GL_FLOAT, gfx::NOT_INSTANCED)
-           .bind_attrib(grid_ssbo, offsetof(GridCell, vel_unknown), sizeof(GridCell), 1, GL_INT, gfx::NOT_INSTANCED);
+        grid_vao.bind_attrib(grid_vel_ssbo, offsetof(GridVelocity, vel), sizeof(GridVelocity), 3, GL_FLOAT, gfx::NOT_INSTANCED)
+           .bind_attrib(grid_flag_ssbo, offsetof(GridFlags, type), sizeof(GridFlags), 1, GL_INT, gfx::NOT_INSTANCED)
+           .bind_attrib(grid_pressure_ssbo, offsetof(GridPressure, rhs), sizeof(GridPressure), 1, GL_FLOAT, gfx::NOT_INSTANCED)
+           .bind_attrib(grid_coefficient_ssbo, offsetof(GridCoefficients, a_diag), sizeof(GridCoefficients), 4, GL_FLOAT, gfx::NOT_INSTANCED)
+           .bind_attrib(grid_pressure_ssbo, offsetof(GridPressure, pressure), sizeof(GridPressure), 1, GL_FLOAT, gfx::NOT_INSTANCED)
+           .bind_attrib(grid_flag_ssbo, offsetof(GridFlags, vel_unknown), sizeof(GridFlags), 1, GL_INT, gfx::NOT_INSTANCED);
 
         debug_lines_vao.bind_attrib(debug_lines_ssbo, offsetof(DebugLine, a), sizeof(DebugLine), 3, GL_FLOAT, gfx::NOT_INSTANCED)
             .bind_attrib(debug_lines_ssbo, offsetof(DebugLine, b), sizeof(DebugLine), 3, GL_FLOAT, gfx::NOT_INSTANCED)
             .bind_attrib(debug_lines_ssbo, offsetof(DebugLine, color), sizeof(DebugLine), 4, GL_FLOAT, gfx::NOT_INSTANCED);
-        
-        
-        reset_grid_program.compute({"common.glsl", "reset_grid.cs.glsl"}).compile();
-        p2g_accumulate_program.compute({"atomic.glsl", "common.glsl", "p2g_common.glsl", "p2g_accumulate.cs.glsl"}).compile();
-        p2g_apply_program.compute({"atomic.glsl", "common.glsl", "p2g_common.glsl", "p2g_apply.cs.glsl"}).compile();
-        grid_to_particle_program.compute({"common.glsl", "grid_to_particle.cs.glsl"}).compile();
-        extrapolate_program.compute({"common.glsl", "extrapolate.cs.glsl"}).compile();
-        set_vel_known_program.compute({"common.glsl", "set_vel_known.cs.glsl"}).compile();
-        body_forces_program.compute({"common.glsl", "enforce_boundary.cs.glsl", "body_forces.cs.glsl"}).compile();
-        setup_grid_project_program.compute({"common.glsl", "setup_project.cs.glsl", "compute_divergence.cs.glsl", "build_a.cs.glsl"}).compile();
-        jacobi_iterate_program.compute({"common.glsl", "jacobi_iterate.cs.glsl"}).compile();
-        pressure_to_guess_program.compute({"common.glsl", "pressure_to_guess.cs.glsl"}).compile();
-        pressure_update_program.compute({"common.glsl", "pressure_update.cs.glsl"}).compile();
-        particle_advect_program.compute({"common.glsl", "rand.glsl", "particle_advect.cs.glsl"}).compile();
-        
-        program.vertex({"particles.vs.glsl"}).fragment({"lighting.glsl", "particles.fs.glsl"}).compile();
+
+        program.vertex({"common.glsl", "particles.vs.glsl"}).fragment({"lighting.glsl", "particles.fs.glsl"}).compile();
         grid_program.vertex({"common.glsl", "grid.vs.glsl"}).geometry({"common.glsl", "grid.gs.glsl"}).fragment({"grid.fs.glsl"}).compile();
         debug_lines_program.vertex({"debug_lines.vs.glsl"}).geometry({"debug_lines.gs.glsl"}).fragment({"debug_lines.fs.glsl"}).compile();
 
-        ssf_spheres_program.vertex({"particles.vs.glsl"}).fragment({"common.glsl", "ssf_spheres.fs.glsl"}).compile();
+        ssf_spheres_program.vertex({"common.glsl", "particles.vs.glsl"}).fragment({"common.glsl", "ssf_spheres.fs.glsl"}).compile();
         ssf_smooth_program.vertex({"screen_quad.vs.glsl"}).fragment({"ssf_smooth.fs.glsl"}).compile();
         ssf_shade_program.vertex({"screen_quad.vs.glsl"}).fragment({"lighting.glsl", "ssf_shade.fs.glsl"}).compile();
     }
 
+    /**
+     * Seed the particles and grid. The first call allocates the simulation
+     * buffers; later calls (resets) overwrite them in place, so a drawing
+     * context sharing them never sees them reallocated.
+     */
     void init_ssbos() {
         std::vector<GridCell> initial_grid;
         std::vector<Particle> initial_particles;
@@ -159,7 +331,8 @@ struct Fluid {
                                 initial_particles.emplace_back(Particle{
                                     particle_pos,
                                     glm::vec3(0),
-                                    glm::vec4(0.32,0.57,0.79,1.0)
+                                    particle_palette.front(),
+                                    static_cast<std::uint32_t>(initial_particles.size())
                                 });
                             }
                         }
@@ -173,20 +346,102 @@ struct Fluid {
                 }
             }
         }
-        particle_ssbo.bind_base(0).set_data(initial_particles, GL_DYNAMIC_COPY);
-        grid_ssbo.bind_base(1).set_data(initial_grid, GL_DYNAMIC_COPY);
+        particle_ssbo.bind_base(0);
+        write_particles(initial_particles);
+        grid_vel_ssbo.bind_base(1);
+        grid_old_vel_ssbo.bind_base(11);
+        grid_pressure_ssbo.bind_base(12);
+        grid_coefficient_ssbo.bind_base(13);
+        grid_flag_ssbo.bind_base(14);
+        write_grid(initial_grid);
         std::cerr << "Cell count: " << initial_grid.size() << std::endl;
         std::cerr << "Particle count: " << initial_particles.size() << std::endl;
 
-        std::vector<DebugLine> debug_lines;
-        debug_lines.push_back(DebugLine({0, 0, 0}, {0.1, 0, 0}, {1, 0, 0, 1})); // x axis
-        debug_lines.push_back(DebugLine({0, 0, 0}, {0, 0.1, 0}, {0, 1, 0, 1})); // y axis
-        debug_lines.push_back(DebugLine({0, 0, 0}, {0, 0, 0.1}, {0, 0, 1, 1})); // z axis
-        debug_lines_ssbo.bind_base(2).set_data(debug_lines); 
+        transfer_ssbo.bind_base(3).update_data(initial_transfer, GL_DYNAMIC_COPY);
+        chebyshev_ssbo.bind_base(7).update_data(std::vector<float>(initial_grid.size()), GL_DYNAMIC_COPY);
+        max_speed_ssbo.bind_base(19).update_data(std::vector<GLuint>{0}, GL_DYNAMIC_COPY);
+        max_speed_readback.update_data(std::vector<GLuint>{0}, GL_STREAM_READ);
+        if (max_speed_fence) {
+            glDeleteSync(max_speed_fence);
+            max_speed_fence = nullptr;
+        }
+        max_speed = 0;
+        if (narrow_band) {
+            grid_band_ssbo.bind_base(18).update_data(std::vector<NarrowBandCell>(initial_grid.size()), GL_DYNAMIC_COPY);
+        }
+        if (fluid_extent.extent_ssbo.id) {
+            // a reset: every particle is in use again (narrow_band culls them); the first call is before fluid_extent.init()
+            fluid_extent.reset(initial_particles.size());
+        }
 
-        transfer_ssbo.bind_base(3).set_data(initial_transfer, GL_DYNAMIC_COPY);
+        if (backend == Backend::CPU) {
+            if (!cpu_sim)
+                cpu_sim = std::make_unique<cpu::Simulation>(grid_dimensions, bounds_min, bounds_max, get_cpu_pool());
+            cpu_sim->gravity = gravity;
+            cpu_sim->reset(initial_particles, initial_grid);
+            cpu_grid_dirty = false;
+            std::cerr << "CPU backend threads: " << cpu_sim->pool.size() << std::endl;
+            std::cerr << "CPU backend G2P kernel: " << cpu::GridToParticle::isa_name(cpu_sim->g2p.isa) << std::endl;
+        }
 
-        std::cout << "Size of debug lines buffer " << debug_lines_ssbo.length() << " (" << debug_lines_ssbo.size() << " bytes)" << std::endl;
+    }
+
+    /**
+     * Compile the tile size, sparse_grid and indirect_dispatch into a grid
+     * kernel (see grid_tile.glsl).
+     */
+    gfx::Program& grid_kernel(gfx::Program& program) {
+        if (sparse_grid) {
+            program.define("SPARSE_GRID", "1");
+        }
+        if (indirect_dispatch) {
+            program.define("INDIRECT_DISPATCH", "1");
+        }
+        return program.define("TILE_X", std::to_string(grid_tile_size.x))
+                      .define("TILE_Y", std::to_string(grid_tile_size.y))
+                      .define("TILE_Z", std::to_string(grid_tile_size.z));
+    }
+
+    /**
+     * Dispatch a grid kernel over size cells, one invocation per cell. With
+     * sparse_grid or indirect_dispatch, over the active bricks or the fluid's
+     * bounding box instead, whatever the size.
+     */
+    void dispatch_grid(const glm::ivec3& size) {
+        if (sparse_grid) {
+            active_bricks.dispatch();
+            return;
+        }
+        if (indirect_dispatch) {
+            fluid_extent.dispatch_grid();
+            return;
+        }
+        const glm::ivec3 groups = (size + grid_tile_size - glm::ivec3(1)) / grid_tile_size;
+        glDispatchCompute(groups.x, groups.y, groups.z);
+    }
+
+    /**
+     * Compile the workgroup size into a particle kernel (see particle_group.glsl).
+     */
+    gfx::Program& particle_kernel(gfx::Program& program) {
+        return program.define("PARTICLE_GROUP_SIZE", std::to_string(particle_group_size));
+    }
+
+    /**
+     * Dispatch a particle kernel over all particles, one invocation per particle.
+     */
+    void dispatch_particles() {
+        if (indirect_dispatch) {
+            fluid_extent.dispatch_particles();
+            return;
+        }
+        glDispatchCompute((particle_ssbo.length() + particle_group_size - 1) / particle_group_size, 1, 1);
+    }
+
+    cpu::ThreadPool& get_cpu_pool() {
+        if (!cpu_pool)
+            cpu_pool = std::make_unique<cpu::ThreadPool>(cpu_threads);
+        return *cpu_pool;
     }
 
     void resize(uint w, uint h) {
@@ -219,6 +474,15 @@ struct Fluid {
         glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
         glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
         glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+    }
+
+    /**
+     * set_common_uniforms() plus the window resolution, for drawing programs.
+     * resolution belongs to the drawing thread (see SimulationThread), so the
+     * simulation kernels don't read it.
+     */
+    void set_draw_uniforms(gfx::Program& program) {
+        set_common_uniforms(program);
         glUniform2iv(program.uniform_loc("resolution"), 1, glm::value_ptr(resolution));
     }
 
@@ -227,110 +491,161 @@ struct Fluid {
         reset_grid_program.use();
         set_common_uniforms(reset_grid_program);
         reset_grid_program.validate();
-        glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+        dispatch_grid(grid_dimensions);
         reset_grid_program.disuse();
     }
 
-    void particle_to_grid_cpu() {
-        const auto particles = particle_ssbo.map_buffer_readonly<Particle>();
-        auto grid = grid_ssbo.map_buffer<GridCell>();
-
-        // clear grid values
-        for (int x = 0; x < grid_dimensions.x; ++x) {
-            for (int y = 0; y < grid_dimensions.y; ++y) {
-                for (int z = 0; z < grid_dimensions.z; ++z) {
-                    const int i = get_grid_index({x, y, z});
-                    grid[i].type = (x < grid_cell_dimensions.x and y < grid_cell_dimensions.y and z < grid_cell_dimensions.z) ? GRID_AIR : GRID_SOLID;
-                    grid[i].vel = glm::vec3(0);
-                }
-            }
+    /**
+     * Gather the grid buffers into one GridCell per cell.
+     */
+    std::vector<GridCell> read_grid() {
+        ssbo_barrier();
+        const auto vel = grid_vel_ssbo.map_buffer_readonly<GridVelocity>();
+        const auto old_vel = grid_old_vel_ssbo.map_buffer_readonly<GridVelocity>();
+        const auto pressure = grid_pressure_ssbo.map_buffer_readonly<GridPressure>();
+        const auto coefficients = grid_coefficient_ssbo.map_buffer_readonly<GridCoefficients>();
+        const auto flags = grid_flag_ssbo.map_buffer_readonly<GridFlags>();
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        std::vector<GridCell> grid;
+        grid.reserve(grid_vel_ssbo.length());
+        for (int i = 0; i < grid_vel_ssbo.length(); ++i) {
+            GridCell& cell = grid.emplace_back(get_world_coord(geom.get_grid_coord_from_index(i)), vel[i].vel, flags[i].type);
+            cell.old_vel = old_vel[i].vel;
+            cell.rhs = pressure[i].rhs;
+            cell.pressure = pressure[i].pressure;
+            cell.pressure_guess = pressure[i].pressure_guess;
+            cell.a_diag = coefficients[i].a_diag;
+            cell.a_x = coefficients[i].a_x;
+            cell.a_y = coefficients[i].a_y;
+            cell.a_z = coefficients[i].a_z;
+            cell.vel_unknown = flags[i].vel_unknown;
         }
+        return grid;
+    }
 
-        // particle to cell transfer
-        std::unordered_map<int, glm::vec3> cell_weights;
-
-        auto transfer_part = [&](const glm::ivec3& grid_coord, const glm::vec3& weights, const glm::vec3& value) {
-            const int index = get_grid_index(grid_coord);
-            const float weight = glm::compMul(weights);
-            grid[index].vel += value * weight;
-            grid[index].vel_unknown = 0;
-            if (value.x != 0)
-                cell_weights[index] += glm::vec3(weight, 0, 0);
-            if (value.y != 0)
-                cell_weights[index] += glm::vec3(0, weight, 0);
-            if (value.z != 0)
-                cell_weights[index] += glm::vec3(0, 0, weight);
-        };
-        
-        auto transfer = [&](const glm::ivec3& base_coord, const glm::vec3& weights, const glm::vec3& value) {
-            transfer_part(base_coord + glm::ivec3(0, 0, 0), {  weights.x,   weights.y,   weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(1, 0, 0), {1-weights.x,   weights.y,   weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(0, 1, 0), {  weights.x, 1-weights.y,   weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(0, 0, 1), {  weights.x,   weights.y, 1-weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(1, 1, 0), {1-weights.x, 1-weights.y,   weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(0, 1, 1), {  weights.x, 1-weights.y, 1-weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(1, 0, 1), {1-weights.x,   weights.y, 1-weights.z}, value);
-            transfer_part(base_coord + glm::ivec3(1, 1, 1), {1-weights.x, 1-weights.y, 1-weights.z}, value);
-        };
-
-        for (int i = 0; i < particle_ssbo.length(); ++i) {
-            const Particle& p = particles[i];
-            const glm::ivec3 grid_coord_center = get_grid_coord(p.pos);
-            const int center_index = get_grid_index(grid_coord_center);
-            grid[center_index].type = GRID_FLUID;
-
-            // u
-            {
-                const glm::ivec3 base_coord = get_grid_coord(p.pos, {-1, 0, 0});
-                const glm::vec3 weights = (p.pos - get_world_coord(base_coord, {1, 0, 0})) / cell_size;
-                transfer(base_coord, weights, {p.vel.x, 0, 0});
-            }
-            // v
-            {
-                const glm::ivec3 base_coord = get_grid_coord(p.pos, {0, -1, 0});
-                const glm::vec3 weights = (p.pos - get_world_coord(base_coord, {0, 1, 0})) / cell_size;
-                transfer(base_coord, weights, {0, p.vel.y, 0});
-            }
-            // w
-            {
-                const glm::ivec3 base_coord = get_grid_coord(p.pos, {0, 0, -1});
-                const glm::vec3 weights = (p.pos - get_world_coord(base_coord, {0, 0, 1})) / cell_size;
-                transfer(base_coord, weights, {0, 0, p.vel.z});
-            }
+    /**
+     * Scatter one GridCell per cell into the grid buffers.
+     */
+    void write_grid(const std::vector<GridCell>& grid) {
+        std::vector<GridVelocity> vel(grid.size());
+        std::vector<GridVelocity> old_vel(grid.size());
+        std::vector<GridPressure> pressure(grid.size());
+        std::vector<GridCoefficients> coefficients(grid.size());
+        std::vector<GridFlags> flags(grid.size());
+        for (size_t i = 0; i < grid.size(); ++i) {
+            const GridCell& cell = grid[i];
+            vel[i].vel = cell.vel;
+            old_vel[i].vel = cell.old_vel;
+            pressure[i] = {cell.pressure, cell.pressure_guess, cell.rhs};
+            coefficients[i] = {cell.a_diag, cell.a_x, cell.a_y, cell.a_z};
+            flags[i] = {cell.type, cell.vel_unknown};
         }
+        grid_vel_ssbo.update_data(vel, GL_DYNAMIC_COPY);
+        grid_old_vel_ssbo.update_data(old_vel, GL_DYNAMIC_COPY);
+        grid_pressure_ssbo.update_data(pressure, GL_DYNAMIC_COPY);
+        grid_coefficient_ssbo.update_data(coefficients, GL_DYNAMIC_COPY);
+        grid_flag_ssbo.update_data(flags, GL_DYNAMIC_COPY);
+    }
 
-        // divide out weights
-        for (int i = 0; i < grid_ssbo.length(); ++i) {
-            // do this conditionally to avoid 0/0 NaNs
-            if (grid[i].vel.x != 0)
-                grid[i].vel.x /= cell_weights[i].x;
-            if (grid[i].vel.y != 0)
-                grid[i].vel.y /= cell_weights[i].y;
-            if (grid[i].vel.z != 0)
-                grid[i].vel.z /= cell_weights[i].z;
+    /**
+     * Decode the particle buffer, whatever its format, into Particles.
+     */
+    std::vector<Particle> read_particles() {
+        // only the particles in use, fewer than the buffer holds with narrow_band
+        const int count = fluid_extent.read().num_particles;
+        std::vector<Particle> particles;
+        particles.reserve(count);
+        const auto mapped = particle_ssbo.map_buffer_readonly<GpuParticle>();
+#ifdef FLUID_COMPACT_PARTICLES
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        for (int i = 0; i < count; ++i) {
+            const CompactParticle& p = mapped[i];
+            particles.emplace_back(p.pos(geom), p.vel(), particle_palette.at(p.palette_index()), p.id);
         }
+#else
+        particles.assign(mapped.get(), mapped.get() + count);
+#endif
+        return particles;
+    }
+
+    /**
+     * Encode Particles into the particle buffer, resizing it if needed.
+     */
+    void write_particles(const std::vector<Particle>& particles) {
+#ifdef FLUID_COMPACT_PARTICLES
+        // colors not in the palette get the first palette entry
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        std::vector<CompactParticle> compact;
+        compact.reserve(particles.size());
+        for (const Particle& p : particles) {
+            const auto color = std::find(particle_palette.begin(), particle_palette.end(), p.color);
+            const std::uint32_t palette_index = color == particle_palette.end() ? 0 : color - particle_palette.begin();
+            compact.emplace_back(geom, p.pos, p.vel, palette_index, p.id);
+        }
+        particle_ssbo.update_data(compact, GL_DYNAMIC_COPY);
+#else
+        particle_ssbo.update_data(particles, GL_DYNAMIC_COPY);
+#endif
+    }
+
+    void particle_to_grid_cpu() {
+        // CPU equivalent of reset_grid() + particle_to_grid(), through read_grid() and write_grid()
+        std::vector<GridCell> grid = read_grid();
+        const std::vector<Particle> particles = read_particles();
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        cpu_p2g.run(get_cpu_pool(), geom, particles.data(), particles.size(), grid.data());
+        write_grid(grid);
+    }
+
+    void sort_particles() {
+        ssbo_barrier();
+        particle_sort.sort(particle_ssbo, particle_ssbo.length());
+    }
+
+    void update_fluid_extent() {
+        ssbo_barrier();
+        fluid_extent.update();
+    }
+
+    void update_active_bricks() {
+        ssbo_barrier();
+        active_bricks.update(particle_ssbo.length());
     }
 
     void particle_to_grid() {
-        constexpr static int group_size = 1024;
-        reset_grid();
+        if (p2g_mode == P2GMode::GATHER) {
+            // needs the cell ranges of the current particle positions, see step()
+            ssbo_barrier();
+            p2g_gather_program.use();
+            set_common_uniforms(p2g_gather_program);
+            p2g_gather_program.validate();
+            dispatch_grid(grid_dimensions);
+            p2g_gather_program.disuse();
+            return;
+        }
 
-        p2g_accumulate_program.use();
-        set_common_uniforms(p2g_accumulate_program);
+        reset_grid();
 
         // accumulate
-        for (int i = 0; i < particle_ssbo.length() / group_size + 1; ++i) {
-            glUniform1i(p2g_accumulate_program.uniform_loc("start_index"), i * group_size);
+        ssbo_barrier();
+        if (p2g_mode == P2GMode::SHARED) {
+            // one workgroup per tile of cells, using the cell ranges of the current particle positions
+            p2g_shared_program.use();
+            set_common_uniforms(p2g_shared_program);
+            p2g_shared_program.validate();
+            dispatch_grid(grid_cell_dimensions);
+        } else {
+            p2g_accumulate_program.use();
+            set_common_uniforms(p2g_accumulate_program);
             p2g_accumulate_program.validate();
-            ssbo_barrier();
-            glDispatchCompute(1, 1, 1);
-        } 
+            dispatch_particles();
+        }
 
         // copy transfer accumulators to grid velocities
         ssbo_barrier();
         p2g_apply_program.use();
         set_common_uniforms(p2g_apply_program);
-        glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+        dispatch_grid(grid_dimensions);
         p2g_apply_program.disuse();
     }
 
@@ -350,11 +665,11 @@ struct Fluid {
         for (int i = 0; i < glm::compMax(grid_dimensions) * 2; ++i) {
             ssbo_barrier();
             extrapolate_program.use();
-            glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+            dispatch_grid(grid_dimensions);
 
             ssbo_barrier();
             set_vel_known_program.use();
-            glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+            dispatch_grid(grid_dimensions);
         }
     }
 
@@ -369,7 +684,7 @@ struct Fluid {
         glUniform3iv(body_forces_program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
         glUniform3fv(body_forces_program.uniform_loc("body_force"), 1, glm::value_ptr(body_force));
         body_forces_program.validate();
-        glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+        dispatch_grid(grid_dimensions);
         body_forces_program.disuse();
     }
 
@@ -381,12 +696,26 @@ struct Fluid {
         glUniform3fv(setup_grid_project_program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
         glUniform3iv(setup_grid_project_program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
         setup_grid_project_program.validate();
-        glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+        dispatch_grid(grid_dimensions);
         setup_grid_project_program.disuse();
     }
 
-    void pressure_solve() {
-        const int iters = 40;
+    void pressure_solve(float dt) {
+        if (pressure_solver == PressureSolver::CG) {
+            ssbo_barrier();
+            pressure_cg.solve(dt);
+            return;
+        }
+        if (pressure_solver == PressureSolver::RED_BLACK_GS) {
+            pressure_solve_rbgs();
+            return;
+        }
+        if (pressure_solver == PressureSolver::CHEBYSHEV) {
+            pressure_solve_chebyshev();
+            return;
+        }
+
+        const int iters = pressure_iterations;
 
         jacobi_iterate_program.use();
         set_common_uniforms(jacobi_iterate_program);
@@ -399,14 +728,112 @@ struct Fluid {
         for (int i = 0; i < iters; ++i) {
             ssbo_barrier();
             jacobi_iterate_program.use();
-            glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+            dispatch_grid(grid_dimensions);
 
             ssbo_barrier();
             pressure_to_guess_program.use();
-            glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+            dispatch_grid(grid_dimensions);
         }
     }
 
+    void pressure_solve_rbgs() {
+        rbgs_iterate_program.use();
+        set_common_uniforms(rbgs_iterate_program);
+        glUniform1f(rbgs_iterate_program.uniform_loc("omega"), sor_omega);
+        rbgs_iterate_program.validate();
+
+        for (int i = 0; i < pressure_iterations; ++i) {
+            for (int color = 0; color < 2; ++color) {
+                ssbo_barrier();
+                glUniform1i(rbgs_iterate_program.uniform_loc("color"), color);
+                dispatch_grid(glm::ivec3((grid_dimensions.x + 1) / 2, grid_dimensions.y, grid_dimensions.z));
+            }
+        }
+        rbgs_iterate_program.disuse();
+    }
+
+    void pressure_solve_chebyshev() {
+        // the only readback: the spectral radius, estimated on the CPU now and then
+        if (jacobi_radius < 0 or (chebyshev_estimate_interval > 0 and steps_since_estimate >= chebyshev_estimate_interval)) {
+            const std::vector<GridCell> grid = read_grid();
+            const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+            jacobi_radius = cpu::estimate_jacobi_radius(geom, grid.data());
+            steps_since_estimate = 0;
+        }
+        ++steps_since_estimate;
+
+        chebyshev_iterate_program.use();
+        set_common_uniforms(chebyshev_iterate_program);
+        chebyshev_iterate_program.validate();
+
+        chebyshev_shift_program.use();
+        set_common_uniforms(chebyshev_shift_program);
+        chebyshev_shift_program.validate();
+
+        // Chebyshev semi-iterative weights for the Jacobi iteration; no reductions needed
+        const float rho_squared = jacobi_radius * jacobi_radius;
+        float omega = 1;
+        for (int i = 0; i < pressure_iterations; ++i) {
+            if (i == 1)
+                omega = 2 / (2 - rho_squared);
+            else if (i > 1)
+                omega = 4 / (4 - rho_squared * omega);
+
+            ssbo_barrier();
+            chebyshev_iterate_program.use();
+            glUniform1f(chebyshev_iterate_program.uniform_loc("omega"), omega);
+            dispatch_grid(grid_dimensions);
+
+            ssbo_barrier();
+            chebyshev_shift_program.use();
+            dispatch_grid(grid_dimensions);
+        }
+        chebyshev_shift_program.disuse();
+    }
+
+    void narrow_band_carry(float dt) {
+        ssbo_barrier();
+        narrow_band_carry_program.use();
+        set_common_uniforms(narrow_band_carry_program);
+        glUniform1f(narrow_band_carry_program.uniform_loc("dt"), dt);
+        dispatch_grid(grid_dimensions);
+        narrow_band_carry_program.disuse();
+    }
+
+    void narrow_band_fill() {
+        ssbo_barrier();
+        narrow_band_fill_program.use();
+        set_common_uniforms(narrow_band_fill_program);
+        dispatch_grid(grid_dimensions);
+        narrow_band_fill_program.disuse();
+
+        narrow_band_depth_program.use();
+        set_common_uniforms(narrow_band_depth_program);
+        for (int sweep = 0; sweep <= narrow_band_width + 1; ++sweep) {
+            ssbo_barrier();
+            glUniform1i(narrow_band_depth_program.uniform_loc("sweep"), sweep);
+            dispatch_grid(grid_dimensions);
+        }
+        narrow_band_depth_program.disuse();
+    }
+
+    void narrow_band_reseed() {
+        ssbo_barrier();
+        narrow_band_reseed_program.use();
+        set_common_uniforms(narrow_band_reseed_program);
+        glUniform1i(narrow_band_reseed_program.uniform_loc("particle_density"), particle_density);
+        glUniform1ui(narrow_band_reseed_program.uniform_loc("seed"), narrow_band_steps++);
+        glUniform4fv(narrow_band_reseed_program.uniform_loc("seed_color"), 1, glm::value_ptr(particle_palette.front()));
+        dispatch_grid(grid_dimensions);
+        narrow_band_reseed_program.disuse();
+
+        ssbo_barrier();
+        narrow_band_count_program.use();
+        glUniform1ui(narrow_band_count_program.uniform_loc("particle_group_size"), particle_group_size);
+        glDispatchCompute(1, 1, 1);
+        narrow_band_count_program.disuse();
+    }
+
     void pressure_update(float dt) {
         ssbo_barrier();
         pressure_update_program.use();
@@ -415,138 +842,241 @@ struct Fluid {
         glUniform3fv(pressure_update_program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
         glUniform3iv(pressure_update_program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
         pressure_update_program.validate();
-        glDispatchCompute(grid_dimensions.x, grid_dimensions.y, grid_dimensions.z);
+        dispatch_grid(grid_dimensions);
         pressure_update_program.disuse();
     }
 
     void pressure_solve_eigen() {
-        ssbo_barrier();
-        auto grid = grid_ssbo.map_buffer<GridCell>();
-        const glm::ivec3& dim = grid_cell_dimensions;
-        const int n = glm::compMul(dim);
-        auto in_bounds = [&](const glm::ivec3& c) {
-            return c.x >= 0 and c.y >= 0 and c.z >= 0 and c.x < dim.x and c.y < dim.y and c.z < dim.z;
-        };
-        auto index = [&](const glm::ivec3& c){
-            return c.x * (dim.x * dim.y) + c.y * dim.x + c.z;
-        };
-        
-        Eigen::SparseMatrix<float> A;
-        Eigen::VectorXf b(n);
-
-        std::vector<Eigen::Triplet<float>> triplets;
-
-        auto add_neighbor = [&](const glm::ivec3& c, int dx, int dy, int dz){
-            const glm::ivec3 offset = glm::ivec3(dx, dy, dz);
-            if (in_bounds(c + offset)) {
-                int i = get_grid_index(c);
-                int io = get_grid_index(c + offset);
-                float f = 0;
-                if (dx < 0)
-                    f = grid[io].a_x;
-                else if (dx > 0)
-                    f = grid[i].a_x;
-                else if (dy < 0)
-                    f = grid[io].a_y;
-                else if (dy > 0)
-                    f = grid[i].a_y;
-                else if (dz < 0)
-                    f = grid[io].a_z;
-                else if (dz > 0)
-                    f = grid[i].a_z;
-                else
-                    f = grid[i].a_diag;
-                triplets.emplace_back(index(c), index(c + offset), f);
-            }
-        };
-
-        for (int x = 0; x < dim.x; ++x) {
-            for (int y = 0; y < dim.y; ++y) {
-                for (int z = 0; z < dim.z; ++z) {
-                    const glm::ivec3 coord = glm::ivec3(x,y,z);
-                    add_neighbor(coord, -1, 0, 0);
-                    add_neighbor(coord, 0, -1, 0);
-                    add_neighbor(coord, 0, 0, -1);
-                    add_neighbor(coord, 1, 0, 0);
-                    add_neighbor(coord, 0, 1, 0);
-                    add_neighbor(coord, 0, 0, 1);
-                    add_neighbor(coord, 0, 0, 0);
-                    b(index(coord)) = grid[get_grid_index(coord)].rhs;
-                }
-            }
-        }
-
-        A.resize(n, n);
-        A.setFromTriplets(triplets.begin(), triplets.end());
-
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, 1, Eigen::DiagonalPreconditioner<float>> solver;
-        solver.compute(A);
-        Eigen::VectorXf p = solver.solve(b);
-        if (solver.info() != Eigen::Success) {
-            throw std::runtime_error("Didn't converge");
-        }
+        std::vector<GridCell> grid = read_grid();
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        cpu_eigen.solve(geom, grid.data());
+        write_grid(grid);
+    }
 
-        for (int x = 0; x < dim.x; ++x) {
-            for (int y = 0; y < dim.y; ++y) {
-                for (int z = 0; z < dim.z; ++z) {
-                    const glm::ivec3 coord = glm::ivec3(x, y, z);
-                    grid[get_grid_index(coord)].pressure = p(index(coord));
-                }
-            }
-        }
+    void pressure_solve_pcg() {
+        // matrix-free alternative to pressure_solve_eigen(), on the grid read back from the GPU
+        std::vector<GridCell> grid = read_grid();
+        const cpu::GridGeometry geom(grid_dimensions, bounds_min, bounds_max);
+        cpu_pcg.solve(get_cpu_pool(), geom, grid.data());
+        write_grid(grid);
     }
 
     void grid_to_particle() {
         ssbo_barrier();
         grid_to_particle_program.use();
-        glUniform3fv(grid_to_particle_program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
-        glUniform3fv(grid_to_particle_program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
-        glUniform3iv(grid_to_particle_program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
-        glUniform1f(grid_to_particle_program.uniform_loc("pic_flip_blend"), pic_flip_blend);
+        set_grid_to_particle_uniforms(grid_to_particle_program);
         grid_to_particle_program.validate();
-        glDispatchCompute(particle_ssbo.length(), 1, 1);
+        dispatch_particles();
         grid_to_particle_program.disuse();
     }
 
     void particle_advect(float dt) {
         ssbo_barrier();
         particle_advect_program.use();
-        glUniform1f(particle_advect_program.uniform_loc("dt"), dt);
-        glUniform3fv(particle_advect_program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
-        glUniform3fv(particle_advect_program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
-        glUniform3iv(particle_advect_program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
-        glUniform3fv(particle_advect_program.uniform_loc("eye"), 1, glm::value_ptr(eye));
-        glUniform3fv(particle_advect_program.uniform_loc("mouse_pos"), 1, glm::value_ptr(world_mouse_pos));
-        glUniform3fv(particle_advect_program.uniform_loc("mouse_vel"), 1, glm::value_ptr(world_mouse_vel));
-        glDispatchCompute(particle_ssbo.length(), 1, 1);
+        set_particle_advect_uniforms(particle_advect_program, dt);
+        dispatch_particles();
         particle_advect_program.disuse();
     }
 
+    void grid_to_particle_advect(float dt) {
+        // same as grid_to_particle() followed by particle_advect(dt)
+        ssbo_barrier();
+        g2p_advect_program.use();
+        set_grid_to_particle_uniforms(g2p_advect_program);
+        set_particle_advect_uniforms(g2p_advect_program, dt);
+        g2p_advect_program.validate();
+        dispatch_particles();
+        g2p_advect_program.disuse();
+    }
+
+    void set_grid_to_particle_uniforms(gfx::Program& program) {
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+        glUniform1f(program.uniform_loc("pic_flip_blend"), pic_flip_blend);
+    }
+
+    void set_particle_advect_uniforms(gfx::Program& program, float dt) {
+        glUniform1f(program.uniform_loc("dt"), dt);
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+        glUniform3fv(program.uniform_loc("eye"), 1, glm::value_ptr(eye));
+        glUniform3fv(program.uniform_loc("mouse_pos"), 1, glm::value_ptr(world_mouse_pos));
+        glUniform3fv(program.uniform_loc("mouse_vel"), 1, glm::value_ptr(world_mouse_vel));
+    }
+
     void ssbo_barrier() {
         // https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glMemoryBarrier.xhtml
         glMemoryBarrier(GL_ALL_BARRIER_BITS);
     }
 
+    void step_cpu(float dt) {
+        cpu_sim->pic_flip_blend = pic_flip_blend;
+        cpu_sim->eye = eye;
+        cpu_sim->world_mouse_pos = world_mouse_pos;
+        cpu_sim->world_mouse_vel = world_mouse_vel;
+        cpu_sim->step(dt);
+
+        // particles are needed for every frame; the grid only when it is drawn
+        write_particles(cpu_sim->particles);
+        if (eager_cpu_grid) {
+            write_grid(cpu_sim->grid);
+        } else {
+            cpu_grid_dirty = true;
+        }
+    }
+
+    /**
+     * Measure the fastest velocity component next to the fluid on the GPU, and
+     * copy it for max_cell_speed() to read once the GPU is done.
+     */
+    void measure_max_speed() {
+        max_speed_ssbo.bind();
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        max_speed_ssbo.unbind();
+
+        ssbo_barrier();
+        max_speed_program.use();
+        set_common_uniforms(max_speed_program);
+        dispatch_grid(grid_dimensions);
+        max_speed_program.disuse();
+
+        ssbo_barrier();
+        glBindBuffer(GL_COPY_READ_BUFFER, max_speed_ssbo.id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, max_speed_readback.id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (max_speed_fence) {
+            glDeleteSync(max_speed_fence);
+        }
+        max_speed_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /**
+     * Fastest velocity component next to the fluid in cells per second, at the
+     * end of the last step_frame() the GPU has finished. Doesn't wait for the
+     * GPU: while the last measurement is still running, this is the one before.
+     */
+    float max_cell_speed() {
+        if (backend == Backend::CPU) {
+            return cpu_sim->max_cell_speed();
+        }
+        if (max_speed_fence) {
+            const GLenum status = glClientWaitSync(max_speed_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_ALREADY_SIGNALED or status == GL_CONDITION_SATISFIED) {
+                glDeleteSync(max_speed_fence);
+                max_speed_fence = nullptr;
+                const auto bits = max_speed_readback.map_buffer_readonly<GLuint>();
+                std::memcpy(&max_speed, &bits[0], sizeof(max_speed));
+            }
+        }
+        return max_speed;
+    }
+
+    /**
+     * Advance by dt in equal substeps short enough that no velocity crosses
+     * more than cfl_number cells per substep, judged by the fastest velocity at
+     * the end of the last finished frame plus what gravity can add within a step
+     * (sqrt(5 h g), as in Bridson's "Fluid Simulation for Computer Graphics").
+     * Takes at most max_substeps; the count and length are left in substeps
+     * and substep_dt.
+     */
+    void step_frame() {
+        const float gravity_speed = glm::compMax(glm::sqrt(5.f * glm::abs(gravity) / cell_size));
+        const float speed = max_cell_speed() + gravity_speed;
+        const int needed = speed > 0 ? static_cast<int>(std::ceil(dt * speed / cfl_number)) : 1;
+        substeps = std::clamp(needed, 1, max_substeps);
+        substep_dt = dt / substeps;
+        for (int i = 0; i < substeps; ++i) {
+            step(substep_dt, i == substeps - 1);
+        }
+    }
+
     void step() {
-        const float dt = 0.02;
+        step(dt);
+    }
+
+    /**
+     * One step of dt; with measure_speed, also measures the velocity for the
+     * next step_frame().
+     */
+    void step(float dt, bool measure_speed = false) {
+        if (backend == Backend::CPU) {
+            step_cpu(dt);
+            return;
+        }
+
+        // narrow band FLIP culls particles and finds the empty cells of the band in the sort
+        if (p2g_mode != P2GMode::SCATTER or narrow_band or (sort_interval > 0 and ++steps_since_sort >= sort_interval)) {
+            sort_particles();
+            steps_since_sort = 0;
+        }
+        if (sparse_grid) {
+            update_active_bricks();
+        }
+        if (indirect_dispatch) {
+            update_fluid_extent();
+        }
+        if (narrow_band) {
+            narrow_band_carry(dt);
+        }
         particle_to_grid();
+        if (narrow_band) {
+            narrow_band_fill();
+        }
         // extrapolate();
         apply_body_forces(dt);
         setup_grid_project(dt);
-        pressure_solve();
+        pressure_solve(dt);
         pressure_update(dt);
-        grid_to_particle();
-        particle_advect(dt);
+        if (measure_speed) {
+            measure_max_speed();
+        }
+        if (narrow_band) {
+            narrow_band_reseed();
+        }
+        if (fuse_g2p_advect) {
+            grid_to_particle_advect(dt);
+        } else {
+            grid_to_particle();
+            particle_advect(dt);
+        }
+    }
+
+    /**
+     * Draw the particles of another buffer of particle_ssbo's size and layout
+     * from now on, with the particle count of an extent buffer like
+     * fluid_extent's (see SimulationThread). Call on the drawing context:
+     * buffer bindings and the vertex layout are per context.
+     */
+    void set_draw_particles(const gfx::Buffer& particles, const gfx::Buffer& extent) {
+        drawn_particles = &particles;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles.id);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, extent.id);
+#ifndef FLUID_COMPACT_PARTICLES
+        vao.attrib_index(1)
+           .bind_attrib(particles, offsetof(Particle, pos), sizeof(Particle), 3, GL_FLOAT, gfx::INSTANCED)
+           .bind_attrib(particles, offsetof(Particle, vel), sizeof(Particle), 3, GL_FLOAT, gfx::INSTANCED)
+           .bind_attrib(particles, offsetof(Particle, color), sizeof(Particle), 4, GL_FLOAT, gfx::INSTANCED);
+#endif
+    }
+
+    void set_particle_palette_uniforms(gfx::Program& program) {
+        glUniform4fv(program.uniform_loc("palette"), std::min<int>(particle_palette.size(), CompactParticle::palette_size), glm::value_ptr(particle_palette.front()));
     }
 
     void draw_particles(const glm::mat4& projection, const glm::mat4& view, const glm::vec4& viewport) {
         program.use();
+        set_draw_uniforms(program);
+        set_particle_palette_uniforms(program);
         glUniformMatrix4fv(program.uniform_loc("projection"), 1, GL_FALSE, glm::value_ptr(projection));
         glUniformMatrix4fv(program.uniform_loc("view"), 1, GL_FALSE, glm::value_ptr(view));
         glUniform4fv(program.uniform_loc("viewport"), 1, glm::value_ptr(viewport));
         glUniform3fv(program.uniform_loc("look"), 1, glm::value_ptr(look));
         vao.bind();
-        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, particle_ssbo.length());
+        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, drawn_particles->length());
         vao.unbind();
         program.disuse();
     }
@@ -556,7 +1086,8 @@ struct Fluid {
 
         // render spheres and position data
         ssf_spheres_program.use();
-            set_common_uniforms(ssf_spheres_program);
+            set_draw_uniforms(ssf_spheres_program);
+            set_particle_palette_uniforms(ssf_spheres_program);
             glUniformMatrix4fv(ssf_spheres_program.uniform_loc("projection"), 1, GL_FALSE, glm::value_ptr(projection));
             glUniformMatrix4fv(ssf_spheres_program.uniform_loc("view"), 1, GL_FALSE, glm::value_ptr(view));
             glUniform4fv(ssf_spheres_program.uniform_loc("viewport"), 1, glm::value_ptr(viewport));
@@ -577,7 +1108,7 @@ struct Fluid {
             glUniform1i(ssf_spheres_program.uniform_loc("pass"), 0);
             constexpr static GLenum first_pass_buffers[]{GL_COLOR_ATTACHMENT0, GL_NONE};
             glDrawBuffers(2, first_pass_buffers);
-            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, particle_ssbo.length());
+            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, drawn_particles->length());
 
             // sphere position pass
             glDisable(GL_BLEND);
@@ -585,7 +1116,7 @@ struct Fluid {
             glUniform1i(ssf_spheres_program.uniform_loc("pass"), 1);
             constexpr static GLenum second_pass_buffers[]{GL_NONE, GL_COLOR_ATTACHMENT1};
             glDrawBuffers(2, second_pass_buffers);
-            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, particle_ssbo.length());
+            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, num_circle_vertices, drawn_particles->length());
             
             ssf_a_texture.unbind_framebuffer();
             vao.unbind();
@@ -611,9 +1142,10 @@ struct Fluid {
         ssf_shade_program.use();
             glUniform2iv(ssf_shade_program.uniform_loc("resolution"), 1, glm::value_ptr(resolution));
             glUniformMatrix4fv(ssf_shade_program.uniform_loc("projection"), 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(ssf_shade_program.uniform_loc("inv_view"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+            const glm::mat4 inv_view = glm::inverse(view);
+            glUniformMatrix4fv(ssf_shade_program.uniform_loc("inv_view"), 1, GL_FALSE, glm::value_ptr(inv_view));
             glUniform3fv(ssf_shade_program.uniform_loc("look"), 1, glm::value_ptr(look));
-            glUniform3fv(ssf_shade_program.uniform_loc("eye"), 1, glm::value_ptr(eye));
+            glUniform3fv(ssf_shade_program.uniform_loc("eye"), 1, glm::value_ptr(glm::vec3(inv_view[3]))); // not the eye member, which the simulation may be reading
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, ssf_a_texture.color_id);
             glActiveTexture(GL_TEXTURE1);
@@ -628,6 +1160,11 @@ struct Fluid {
     }
 
     void draw_grid(const glm::mat4& projection, const glm::mat4& view, int display_mode) {
+        if (cpu_grid_dirty) {
+            write_grid(cpu_sim->grid);
+            cpu_grid_dirty = false;
+        }
+
         grid_program.use();
         glUniform3fv(grid_program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
         glUniform3fv(grid_program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
@@ -637,7 +1174,7 @@ struct Fluid {
         glUniform1i(grid_program.uniform_loc("display_mode"), display_mode);
         grid_vao.bind();
         glPointSize(16.0);
-        glDrawArrays(GL_POINTS, 0, grid_ssbo.length());
+        glDrawArrays(GL_POINTS, 0, grid_vel_ssbo.length());
         grid_vao.unbind();
         grid_program.disuse();
     }
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Size of the simulation: grid resolution, domain extents and time step, read
+ * at startup from a config file or the command line.
+ *
+ * Cells don't have to be cubes. The domain is split into grid_cells cells along
+ * each axis, so the cell size of each axis is its extent over its cell count;
+ * alternatively, setting cell_size picks the cell counts that fit the domain
+ * and rounds bounds_max to a whole number of cells.
+ *
+ * Config files hold one `key = value` per line, `#` starts a comment. The keys
+ * are the member names; vector values are 3 numbers separated by spaces or
+ * commas, or a single number for all 3 axes:
+ *
+ *     grid = 256 64 128
+ *     bounds_min = -4 -1 -2
+ *     bounds_max = 4 1 2
+ *
+ * On the command line the same keys are options with dashes, e.g.
+ * `--bounds-min -4,-1,-2`.
+ */
+struct FluidConfig {
+    glm::ivec3 grid{24}; // cells along each axis
+    glm::vec3 bounds_min{-1};
+    glm::vec3 bounds_max{1};
+    glm::vec3 cell_size{0}; // overrides grid if nonzero, see resolve()
+    int particle_density = 8; // particles seeded per fluid cell
+    float dt = 0.02; // seconds per step
+
+    /**
+     * Set a value by key, throwing on unknown keys and malformed values.
+     */
+    void set(const std::string& key, const std::string& value) {
+        if (key == "grid") { grid = glm::ivec3(parse_vec3(key, value)); }
+        else if (key == "bounds_min") { bounds_min = parse_vec3(key, value); }
+        else if (key == "bounds_max") { bounds_max = parse_vec3(key, value); }
+        else if (key == "cell_size") { cell_size = parse_vec3(key, value); }
+        else if (key == "particle_density") { particle_density = parse_numbers(key, value, 1)[0]; }
+        else if (key == "dt") { dt = parse_numbers(key, value, 1)[0]; }
+        else { throw std::runtime_error("Unknown fluid config key: " + key); }
+    }
+
+    /**
+     * Whether a command line option names a key, like --bounds-min for bounds_min.
+     */
+    static bool is_option(const std::string& option) {
+        const std::string key = option_key(option);
+        return key == "grid" or key == "bounds_min" or key == "bounds_max" or key == "cell_size" or key == "particle_density" or key == "dt";
+    }
+
+    void set_option(const std::string& option, const std::string& value) {
+        set(option_key(option), value);
+    }
+
+    /**
+     * Set the keys of a config file.
+     */
+    void load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Could not open fluid config: " + path);
+        }
+        std::string line;
+        for (int line_number = 1; std::getline(file, line); ++line_number) {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            const size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                throw std::runtime_error(path + ":" + std::to_string(line_number) + ": expected key = value");
+            }
+            set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)));
+        }
+    }
+
+    /**
+     * Copy with grid and bounds_max derived from cell_size if it's set, checked
+     * for sizes the simulation can't use.
+     */
+    FluidConfig resolve() const {
+        FluidConfig resolved = *this;
+        if (glm::any(glm::notEqual(cell_size, glm::vec3(0)))) {
+            if (glm::any(glm::lessThanEqual(cell_size, glm::vec3(0)))) {
+                throw std::runtime_error("Fluid cell size must be positive along every axis.");
+            }
+            resolved.grid = glm::max(glm::ivec3(glm::round((bounds_max - bounds_min) / cell_size)), glm::ivec3(1));
+            resolved.bounds_max = bounds_min + glm::vec3(resolved.grid) * cell_size;
+        }
+        if (glm::any(glm::lessThan(resolved.grid, glm::ivec3(2)))) {
+            throw std::runtime_error("The fluid grid needs at least 2 cells along every axis.");
+        }
+        if (glm::any(glm::lessThanEqual(resolved.bounds_max, resolved.bounds_min))) {
+            throw std::runtime_error("Fluid bounds_max must be greater than bounds_min along every axis.");
+        }
+        if (particle_density < 0 or dt <= 0) {
+            throw std::runtime_error("Fluid particle_density must be at least 0 and dt positive.");
+        }
+        resolved.cell_size = (resolved.bounds_max - resolved.bounds_min) / glm::vec3(resolved.grid);
+        return resolved;
+    }
+
+private:
+    static std::string option_key(const std::string& option) {
+        if (option.rfind("--", 0) != 0)
+            return "";
+        std::string key = option.substr(2);
+        std::replace(key.begin(), key.end(), '-', '_');
+        return key;
+    }
+
+    static std::string trim(const std::string& s) {
+        const size_t begin = s.find_first_not_of(" \t\r");
+        const size_t end = s.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+    }
+
+    static std::vector<float> parse_numbers(const std::string& key, std::string value, size_t max_count) {
+        std::replace(value.begin(), value.end(), ',', ' ');
+        std::istringstream stream(value);
+        std::vector<float> numbers;
+        float x;
+        while (stream >> x) {
+            numbers.push_back(x);
+        }
+        if (numbers.empty() or numbers.size() > max_count or !stream.eof()) {
+            throw std::runtime_error("Bad value for fluid config key " + key + ": " + value);
+        }
+        return numbers;
+    }
+
+    static glm::vec3 parse_vec3(const std::string& key, const std::string& value) {
+        const std::vector<float> numbers = parse_numbers(key, value, 3);
+        if (numbers.size() == 1)
+            return glm::vec3(numbers[0]);
+        if (numbers.size() != 3) {
+            throw std::runtime_error("Fluid config key " + key + " needs 1 or 3 numbers: " + value);
+        }
+        return {numbers[0], numbers[1], numbers[2]};
+    }
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "gfx/object.hpp"
+#include "gfx/program.hpp"
+
+/**
+ * Particle count and fluid bounding box on the GPU, and indirect dispatches
+ * sized from them so the host never reads anything back to size work.
+ *
+ * Every step, update() reduces the cell bounds of the particles and widens
+ * them by FLUID_MARGIN (common.glsl). Grid kernels compiled with
+ * INDIRECT_DISPATCH and launched with dispatch_grid() then cover the tiles of
+ * that box, joined with last step's so cells the fluid left are cleared once.
+ * Particle kernels launched with dispatch_particles() cover num_particles,
+ * which all particle kernels check against through particle_count().
+ */
+struct FluidExtent {
+    struct DispatchIndirectCommand {
+        GLuint num_groups_x;
+        GLuint num_groups_y;
+        GLuint num_groups_z;
+    };
+
+    // FluidExtentBlock in common.glsl
+    struct Extent {
+        DispatchIndirectCommand grid_groups;
+        DispatchIndirectCommand particle_groups;
+        GLuint num_particles;
+        GLuint num_active_cells;
+        alignas(16) glm::ivec3 grid_tile_origin;
+        GLuint next_particle_id;
+        alignas(16) glm::ivec3 particle_min;
+        alignas(16) glm::ivec3 particle_max;
+        alignas(16) glm::ivec3 occupied_min;
+        alignas(16) glm::ivec3 occupied_max;
+        alignas(16) glm::ivec3 active_min;
+        alignas(16) glm::ivec3 active_max;
+    };
+
+    glm::ivec3 grid_dimensions{0};
+    glm::vec3 bounds_min{0};
+    glm::vec3 bounds_max{0};
+    glm::ivec3 tile_size{0};
+    int particle_group_size = 256;
+
+    gfx::Buffer extent_ssbo{GL_SHADER_STORAGE_BUFFER}; // one Extent
+
+    gfx::Program reduce_program; // particle bounds
+    gfx::Program dispatch_program; // active box and dispatch sizes
+
+    void init(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max, const glm::ivec3& tile_size, int num_particles, int particle_group_size) {
+        this->grid_dimensions = grid_dimensions;
+        this->bounds_min = bounds_min;
+        this->bounds_max = bounds_max;
+        this->tile_size = tile_size;
+        this->particle_group_size = particle_group_size;
+        reset(num_particles); // the first step covers the whole grid
+
+        reduce_program.define("PARTICLE_GROUP_SIZE", std::to_string(particle_group_size)).compute({"common.glsl", "particle_group.glsl", "fluid_extent_reduce.cs.glsl"}).compile();
+        dispatch_program.compute({"common.glsl", "fluid_extent_dispatch.cs.glsl"}).compile();
+    }
+
+    /**
+     * Start over with num_particles particles in use, e.g. after the particles
+     * are reseeded.
+     */
+    void reset(int num_particles) {
+        Extent extent{};
+        extent.grid_groups = {0, 0, 0};
+        extent.particle_groups = {static_cast<GLuint>((num_particles + particle_group_size - 1) / particle_group_size), 1, 1};
+        extent.num_particles = num_particles;
+        extent.next_particle_id = num_particles;
+        extent.particle_min = grid_dimensions;
+        extent.particle_max = glm::ivec3(-1);
+        extent.occupied_min = glm::ivec3(0);
+        extent.occupied_max = grid_dimensions - glm::ivec3(1);
+        extent.active_min = extent.occupied_min;
+        extent.active_max = extent.occupied_max;
+        extent_ssbo.bind_base(17).update_data(std::vector<Extent>{extent}, GL_DYNAMIC_COPY);
+    }
+
+    /**
+     * Recompute the extents and dispatch sizes from the current particles.
+     */
+    void update() {
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        use(reduce_program);
+        dispatch_particles();
+        use(dispatch_program);
+        glUniform3iv(dispatch_program.uniform_loc("tile_size"), 1, glm::value_ptr(tile_size));
+        glUniform1ui(dispatch_program.uniform_loc("particle_group_size"), particle_group_size);
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glDispatchCompute(1, 1, 1);
+        dispatch_program.disuse();
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    }
+
+    /**
+     * Launch the bound grid kernel over the tiles of the active box.
+     */
+    void dispatch_grid() {
+        dispatch_indirect(offsetof(Extent, grid_groups));
+    }
+
+    /**
+     * Launch the bound particle kernel over the particles in use.
+     */
+    void dispatch_particles() {
+        dispatch_indirect(offsetof(Extent, particle_groups));
+    }
+
+    /**
+     * Read back the extents (synchronizes with the GPU).
+     */
+    Extent read() {
+        const auto extent = extent_ssbo.map_buffer_readonly<Extent>();
+        return extent[0];
+    }
+
+private:
+    void use(gfx::Program& program) {
+        program.use();
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+    }
+
+    void dispatch_indirect(GLintptr offset) {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, extent_ssbo.id);
+        glDispatchComputeIndirect(offset);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Fixed time step scheduling for the simulation, decoupled from rendering.
+ *
+ * Every rendered frame, frames_due() says how many simulation frames of
+ * frame_time to run so simulated time keeps up with real time: none when
+ * rendering is faster than the simulation, several when it is slower. Real
+ * time that isn't a whole frame yet carries over to the next call. At most
+ * max_frames run per call; beyond that the simulation drops the backlog and
+ * falls behind real time, instead of taking ever longer to catch up (and so
+ * falling further behind every call).
+ */
+struct FrameScheduler {
+    enum class Mode {
+        REAL_TIME, // as many frames as real time has advanced
+        UNCAPPED, // one frame per call, as fast as rendering allows, for offline runs
+    };
+
+    Mode mode = Mode::REAL_TIME;
+    double frame_time = 0.02; // simulated seconds per frame
+    int max_frames = 4; // per call, for REAL_TIME
+    double accumulator = 0; // real time not simulated yet
+    double last_time = -1; // of the last call, -1 before the first
+
+    /**
+     * Number of frames to simulate now, at real time now (seconds).
+     */
+    int frames_due(double now) {
+        const double elapsed = last_time < 0 ? 0 : std::max(now - last_time, 0.0);
+        last_time = now;
+        if (mode == Mode::UNCAPPED) {
+            accumulator = 0;
+            return 1;
+        }
+
+        accumulator += elapsed;
+        int frames = static_cast<int>(std::floor(accumulator / frame_time));
+        if (frames > max_frames) {
+            frames = max_frames;
+            accumulator = std::fmod(accumulator, frame_time);
+        } else {
+            accumulator -= frames * frame_time;
+        }
+        return frames;
+    }
+
+    /**
+     * Forget the time since the last call, e.g. after pausing.
+     */
+    void reset() {
+        accumulator = 0;
+        last_time = -1;
+    }
+};
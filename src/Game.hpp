@@ -1,6 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <cstdlib>
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <glad/glad.h>
@@ -9,6 +11,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
+#include <glm/gtx/component_wise.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtx/vec_swizzle.hpp>
@@ -17,7 +20,9 @@
 #include "gfx/rendertexture.hpp"
 #include "Box.hpp"
 #include "Fluid.hpp"
+#include "FrameScheduler.hpp"
 #include "Quad.hpp"
+#include "SimulationThread.hpp"
 #include "util.hpp"
 
 class Game {
@@ -36,8 +41,13 @@ public:
     float camera_pitch = 0;
 
     Fluid fluid;
+    FrameScheduler scheduler; // simulation frames of fluid.dt per rendered frame
+    GLFWwindow* simulation_window = nullptr; // hidden window sharing window's context to simulate on, set before init(); null to simulate in update()
+    std::unique_ptr<SimulationThread> simulation; // with simulation_window
     bool running = false;
     bool do_step = false;
+    bool do_reset = false;
+    float pic_flip_blend;
     bool grid_visible = false;
     bool particles_visible = true;
     bool use_ssf = true;
@@ -49,11 +59,23 @@ public:
     gfx::Program texture_copy_program;
     Quad quad;
 
-    Game(GLFWwindow* window) : window(window) {}
+    Game(GLFWwindow* window, const FluidConfig& config = FluidConfig(), Fluid::Backend backend = Fluid::Backend::GPU, int cpu_threads = 0)
+        : window(window), fluid(config, backend, cpu_threads), pic_flip_blend(fluid.pic_flip_blend), box(fluid.bounds_min, fluid.bounds_max) {
+        scheduler.frame_time = fluid.dt;
+    }
 
     void init() {
         srand(time(0));
-        fluid.init();
+        if (simulation_window) {
+            simulation = std::make_unique<SimulationThread>(fluid,
+                [this]() { glfwMakeContextCurrent(simulation_window); },
+                []() { glfwMakeContextCurrent(nullptr); });
+            simulation->scheduler = scheduler;
+            simulation->start();
+            fluid.init_rendering();
+        } else {
+            fluid.init();
+        }
         texture_copy_program.vertex({"screen_quad.vs.glsl"}).fragment({"texture_copy.fs.glsl"}).compile();
     }
 
@@ -88,32 +110,71 @@ public:
         const float aspect_ratio = static_cast<double>(window_w) / window_h;
         const glm::mat4 projection = glm::perspective(glm::radians(30.f), aspect_ratio, 0.1f, 100.f);
 
-        // view matrix (orbit camera) 
-        glm::vec3 eye(0, 0, -6);
+        // view matrix (orbit camera around the domain, at a distance that fits its largest side)
+        const glm::vec3 center = (fluid.bounds_min + fluid.bounds_max) * 0.5f;
+        glm::vec3 eye(0, 0, -3 * glm::compMax(fluid.bounds_size));
         // TODO: use quaternions
         eye = glm::rotate(eye, camera_yaw, glm::vec3(0, 1, 0));
         eye = glm::rotate(eye, camera_pitch, glm::cross(glm::vec3(0, 1, 0), eye));
-        const glm::mat4 view = glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+        eye += center;
+        const glm::mat4 view = glm::lookAt(eye, center, glm::vec3(0, 1, 0));
         const glm::vec3 look = -glm::xyz(glm::inverse(projection * view) * glm::vec4(0, 0, 1, 0));
-        fluid.eye = eye;
         fluid.look = look;
 
         double mouse_pos_x, mouse_pos_y;
         glfwGetCursorPos(window, &mouse_pos_x, &mouse_pos_y);
-        glm::vec3 mouse_world = glm::unProject(glm::vec3(mouse_pos_x, window_h - mouse_pos_y, 0), view, projection, viewport);
-        fluid.world_mouse_pos = mouse_world;
+        const glm::vec3 mouse_world = glm::unProject(glm::vec3(mouse_pos_x, window_h - mouse_pos_y, 0), view, projection, viewport);
+        glm::vec3 mouse_world_vel(0.f);
         if (mouse_left_dragging) {
-            fluid.world_mouse_vel = ((fluid.world_mouse_pos + glm::normalize(fluid.world_mouse_pos - eye) * 6.f) - (old_world_mouse_pos + glm::normalize(old_world_mouse_pos - eye) * 6.f)) * 10.f;
-        } else {
-            fluid.world_mouse_vel = glm::vec3(0.f);
+            mouse_world_vel = ((mouse_world + glm::normalize(mouse_world - eye) * 6.f) - (old_world_mouse_pos + glm::normalize(old_world_mouse_pos - eye) * 6.f)) * 10.f;
         }
-        old_world_mouse_pos = fluid.world_mouse_pos;
-
-        // simulation step
-        if (running or do_step) {
-            do_step = false;
-            fluid.step();
-            fluid.ssbo_barrier();
+        old_world_mouse_pos = mouse_world;
+
+        if (simulation) {
+            // the worker simulates in real time by itself; draw its last completed frame
+            SimulationThread::Controls controls;
+            controls.running = running;
+            controls.mode = scheduler.mode;
+            controls.eye = eye;
+            controls.world_mouse_pos = mouse_world;
+            controls.world_mouse_vel = mouse_world_vel;
+            controls.pic_flip_blend = pic_flip_blend;
+            simulation->set_controls(controls);
+            if (do_reset) {
+                simulation->request_reset();
+            }
+            if (do_step) {
+                simulation->request_frames(1);
+            }
+            do_reset = do_step = false;
+            simulation->acquire();
+        } else {
+            fluid.eye = eye;
+            fluid.world_mouse_pos = mouse_world;
+            fluid.world_mouse_vel = mouse_world_vel;
+            fluid.pic_flip_blend = pic_flip_blend;
+            if (do_reset) {
+                do_reset = false;
+                fluid.init_ssbos();
+            }
+
+            // simulation, in fixed frames of fluid.dt that keep up with real time
+            int sim_frames = 0;
+            if (running) {
+                sim_frames = scheduler.frames_due(t);
+            } else {
+                scheduler.reset();
+            }
+            if (do_step) {
+                do_step = false;
+                sim_frames = std::max(sim_frames, 1);
+            }
+            for (int i = 0; i < sim_frames; ++i) {
+                fluid.step_frame();
+            }
+            if (sim_frames > 0) {
+                fluid.ssbo_barrier();
+            }
         }
 
         // clear screen
@@ -133,7 +194,7 @@ public:
             box.draw(projection, view, eye);
             if (!use_ssf and particles_visible)
                 fluid.draw_particles(projection, view, viewport);
-            if (grid_visible)
+            if (grid_visible and !simulation) // the worker writes the grid unfenced; only particles are snapshotted
                 fluid.draw_grid(projection, view, grid_display_mode);
         scene_texture.unbind_framebuffer();
 
@@ -151,5 +212,8 @@ public:
             fluid.draw_particles_ssf(scene_texture, projection, view, viewport);
 
         fluid.draw_debug_lines(projection, view);
+        if (simulation) {
+            simulation->release();
+        }
     }
 };
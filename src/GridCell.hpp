@@ -5,6 +5,13 @@ const int GRID_AIR = 0;
 const int GRID_SOLID = 1;
 const int GRID_FLUID = 2;
 
+/**
+ * All fields of one grid cell, as used by the CPU code. On the GPU the grid is
+ * stored as one array per field group instead (velocity, old velocity,
+ * pressure, solver coefficients and flags, see common.glsl), so that kernels
+ * only fetch the fields they use; Fluid::read_grid and Fluid::write_grid
+ * convert between the two.
+ */
 struct GridCell {
     alignas(16) glm::vec3 pos;
     alignas(4)  int type;
@@ -25,3 +32,34 @@ struct GridCell {
 
     GridCell(const glm::vec3& pos, const glm::vec3& vel, int type) : pos(pos), type(type), vel(vel), old_vel(vel) {}
 };
+
+// elements of the GPU grid arrays, std430 layout
+
+struct GridVelocity {
+    alignas(16) glm::vec3 vel;
+};
+
+struct GridPressure {
+    float pressure = 0;
+    float pressure_guess = 0;
+    float rhs = 0;
+};
+
+struct GridCoefficients {
+    float a_diag = 0;
+    float a_x = 0;
+    float a_y = 0;
+    float a_z = 0;
+};
+
+struct GridFlags {
+    int type = GRID_AIR;
+    int vel_unknown = 1;
+};
+
+// narrow band FLIP state, NarrowBandCell in narrow_band_common.glsl
+struct NarrowBandCell {
+    alignas(16) glm::vec3 carried_vel{0};
+    float carried_depth = 0;
+    float depth = 0;
+};
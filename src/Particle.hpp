@@ -1,10 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <glm/glm.hpp>
 
 struct Particle {
     alignas(16) glm::vec4 color;
     alignas(16) glm::vec3 pos;
+    std::uint32_t id; // stable across reordering of the particle buffer
     alignas(16) glm::vec3 vel;
 
-    Particle(glm::vec3 pos, glm::vec3 vel, glm::vec4 color) : color(color), pos(pos), vel(vel) {}
+    Particle(glm::vec3 pos, glm::vec3 vel, glm::vec4 color, std::uint32_t id = 0) : color(color), pos(pos), id(id), vel(vel) {}
 };
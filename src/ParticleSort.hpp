@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "CompactParticle.hpp"
+#include "gfx/object.hpp"
+#include "gfx/program.hpp"
+
+/**
+ * Counting sort of the particle buffer by grid cell on the GPU, so particles
+ * that are close in space are close in memory and neighboring invocations of
+ * the particle kernels touch the same grid cells.
+ *
+ * sort_histogram counts the particles of each cell, remembering each
+ * particle's slot within its cell; a three pass exclusive scan turns the counts
+ * into cell starts; sort_scatter moves each particle to start + slot in a
+ * scratch buffer; sort_cells orders each cell's particles by Particle::id
+ * (the atomic slots depend on scheduling, this makes the result deterministic),
+ * and the scratch buffer is copied back over the particles. Afterwards
+ * cell_ssbo holds the start and count of every cell's particles, valid until
+ * the particles move.
+ *
+ * With narrow_band set, particles deeper below the surface than that many
+ * cells are left out, and the particle count is lowered to the ones kept.
+ */
+struct ParticleSort {
+    constexpr static int scan_group_size = 256; // local_size_x in sort_scan_common.glsl
+    constexpr static int max_groups = 1024; // MAX_SORT_GROUPS in sort_common.glsl
+
+    struct CellRange {
+        GLuint start;
+        GLuint count;
+    };
+
+    glm::ivec3 grid_dimensions{0};
+    glm::vec3 bounds_min{0};
+    glm::vec3 bounds_max{0};
+    int num_cells = 0;
+    int particle_group_size = 256;
+    int narrow_band = -1; // band width for Fluid::narrow_band, compiled into the shaders by init(); -1 to keep every particle
+
+    gfx::Buffer cell_ssbo{GL_SHADER_STORAGE_BUFFER}; // CellRange of every grid cell
+    gfx::Buffer scratch_ssbo{GL_SHADER_STORAGE_BUFFER}; // scan partials and per-particle slots
+    gfx::Buffer sorted_ssbo{GL_SHADER_STORAGE_BUFFER}; // particles in sorted order
+
+    gfx::Program histogram_program; // count particles per cell
+    gfx::Program scan_partials_program; // particle count of each chunk of cells
+    gfx::Program scan_groups_program; // chunk offsets
+    gfx::Program scan_cells_program; // cell starts
+    gfx::Program scatter_program; // move particles to their sorted slots
+    gfx::Program sort_cells_program; // order particles within each cell by id
+
+    void init(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max, int num_particles, int particle_group_size) {
+        this->grid_dimensions = grid_dimensions;
+        this->bounds_min = bounds_min;
+        this->bounds_max = bounds_max;
+        this->particle_group_size = particle_group_size;
+        num_cells = grid_dimensions.x * grid_dimensions.y * grid_dimensions.z;
+
+        cell_ssbo.bind_base(8).set_data(std::vector<CellRange>(num_cells), GL_DYNAMIC_COPY);
+        scratch_ssbo.bind_base(9).set_data(std::vector<GLuint>(max_groups + num_particles), GL_DYNAMIC_COPY);
+        sorted_ssbo.bind_base(10);
+        sorted_ssbo.bind();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GpuParticle) * num_particles, nullptr, GL_DYNAMIC_COPY);
+        sorted_ssbo.unbind();
+
+        const std::string group_size = std::to_string(particle_group_size);
+        if (narrow_band >= 0) {
+            histogram_program.define("NARROW_BAND", std::to_string(narrow_band));
+            scatter_program.define("NARROW_BAND", std::to_string(narrow_band));
+        }
+        histogram_program.define("PARTICLE_GROUP_SIZE", group_size).compute({"common.glsl", "narrow_band_common.glsl", "sort_common.glsl", "particle_group.glsl", "sort_histogram.cs.glsl"}).compile();
+        scan_partials_program.compute({"common.glsl", "sort_common.glsl", "sort_scan_common.glsl", "sort_scan_partials.cs.glsl"}).compile();
+        scan_groups_program.compute({"common.glsl", "sort_common.glsl", "sort_scan_common.glsl", "sort_scan_groups.cs.glsl"}).compile();
+        scan_cells_program.compute({"common.glsl", "sort_common.glsl", "sort_scan_common.glsl", "sort_scan_cells.cs.glsl"}).compile();
+        scatter_program.define("PARTICLE_GROUP_SIZE", group_size).compute({"common.glsl", "narrow_band_common.glsl", "sort_common.glsl", "particle_group.glsl", "sort_scatter.cs.glsl"}).compile();
+        sort_cells_program.compute({"common.glsl", "sort_common.glsl", "sort_cells.cs.glsl"}).compile();
+    }
+
+    /**
+     * Sort num_particles particles of particle_ssbo (bound to binding 0) by cell.
+     */
+    void sort(gfx::Buffer& particle_ssbo, int num_particles) {
+        const int particle_groups = (num_particles + particle_group_size - 1) / particle_group_size;
+        const int scan_groups = std::clamp((num_cells + scan_group_size - 1) / scan_group_size, 1, max_groups);
+
+        cell_ssbo.bind();
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        cell_ssbo.unbind();
+
+        use(histogram_program);
+        dispatch(particle_groups);
+
+        use(scan_partials_program);
+        dispatch(scan_groups);
+        use(scan_groups_program);
+        glUniform1ui(scan_groups_program.uniform_loc("num_partials"), scan_groups);
+        dispatch(1);
+        use(scan_cells_program);
+        dispatch(scan_groups);
+
+        use(scatter_program);
+        dispatch(particle_groups);
+        use(sort_cells_program);
+        dispatch((num_cells + scan_group_size - 1) / scan_group_size);
+        sort_cells_program.disuse();
+
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glBindBuffer(GL_COPY_READ_BUFFER, sorted_ssbo.id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, particle_ssbo.id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GpuParticle) * num_particles);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+private:
+    void use(gfx::Program& program) {
+        program.use();
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+    }
+
+    void dispatch(int groups) {
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glDispatchCompute(groups, 1, 1);
+    }
+};
@@ -0,0 +1,343 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include "gfx/object.hpp"
+#include "gfx/program.hpp"
+
+/**
+ * Conjugate gradient pressure solve on the GPU, by default preconditioned with
+ * a geometric multigrid V-cycle (MGPCG, McAdams et al. 2010).
+ *
+ * The system is the one set up by build_a: unknowns are fluid cells with a
+ * nonzero a_diag, and level 0 of the hierarchy applies the a_diag/a_x/a_y/a_z
+ * coefficients directly. Each coarser level halves the resolution; a coarse
+ * cell is fluid if any of its children is, and its operator is a Laplacian
+ * derived from the cell types alone. The V-cycle smooths with red-black
+ * Gauss-Seidel, restricts residuals by summing children and prolongates
+ * piecewise constant corrections; the sweep order is mirrored on the way up so
+ * the preconditioner stays symmetric.
+ *
+ * All scalars of the iteration (dot products, norms, alpha and beta) are
+ * reduced in workgroup shared memory and stay on the GPU. Once max |r| drops
+ * to tolerance * max |rhs| the kernels stop doing work; the host reads the
+ * residual back every check_interval iterations to stop issuing them, so the
+ * cost follows how hard the system is, up to max_iterations. Warm started from
+ * pressure_guess, and writes the result to both pressure and pressure_guess,
+ * like the Jacobi solver.
+ */
+struct PressureCG {
+    constexpr static int group_size = 256; // local_size_x in pcg_common.glsl
+    constexpr static int max_groups = 1024; // MAX_PARTIALS in pcg_common.glsl
+    constexpr static int scalar_rho = 0; // SCALAR_RHO, two slots
+    constexpr static int scalar_sq = 2; // SCALAR_SQ
+    constexpr static int scalar_residual = 3; // SCALAR_RESIDUAL
+    constexpr static int scalar_threshold = 4; // SCALAR_THRESHOLD
+    constexpr static int scalar_iterations = 5; // SCALAR_ITERATIONS
+    constexpr static int scalar_partials = 8; // SCALAR_PARTIALS
+
+    enum class Preconditioner {
+        NONE, // plain conjugate gradient
+        JACOBI, // diagonal
+        MULTIGRID, // one V-cycle
+    };
+
+    struct Level {
+        glm::ivec3 dim;
+        int size;
+        int x_offset; // solution, z (the preconditioned residual) on level 0
+        int b_offset; // right hand side, r (the residual) on level 0
+        int type_offset;
+    };
+
+    Preconditioner preconditioner = Preconditioner::MULTIGRID;
+    float tolerance = 1e-4; // stop once max |residual| <= tolerance * max |rhs|
+    int max_iterations = 200;
+    int check_interval = 4; // iterations issued between residual readbacks
+    int smooth_sweeps = 2; // red-black sweeps on each level before and after the coarse correction
+    int coarse_sweeps = 16; // red-black sweeps on the coarsest level, each way
+    int coarsest_size = 4; // stop coarsening once a dimension is this small
+    float restrict_scale = 1.0 / 8.0; // weight of the summed child residuals
+
+    int iterations = 0; // iterations taken by the last solve
+    float residual = 0; // max |residual| after the last solve
+
+    glm::ivec3 grid_dimensions{0};
+    glm::vec3 bounds_min{0};
+    glm::vec3 bounds_max{0};
+    std::vector<Level> levels;
+    int x_offset = 0; // conjugate gradient iterate, level 0 sized
+    int s_offset = 0; // search direction
+    int q_offset = 0; // As
+
+    gfx::Buffer data_ssbo{GL_SHADER_STORAGE_BUFFER}; // vectors of all levels
+    gfx::Buffer type_ssbo{GL_SHADER_STORAGE_BUFFER}; // cell types of all levels
+    gfx::Buffer scalar_ssbo{GL_SHADER_STORAGE_BUFFER}; // dot products, norms and partials
+
+    gfx::Program init_program; // warm start from pressure_guess
+    gfx::Program apply_a_program; // Ax, or the residual b - Ax
+    gfx::Program dot_program; // per-workgroup partials of a dot product or max norm
+    gfx::Program reduce_program; // combine the partials into a scalar slot
+    gfx::Program update_pressure_program; // x += alpha s, r -= alpha As
+    gfx::Program update_search_program; // s = z + beta s
+    gfx::Program finalize_program; // copy x to pressure and pressure_guess
+    gfx::Program precondition_program; // z = r or z = r / diag(A)
+    gfx::Program init_types_program; // level 0 cell types from the grid
+    gfx::Program restrict_type_program; // coarse level cell types
+    gfx::Program smooth_program; // red-black Gauss-Seidel half sweep
+    gfx::Program restrict_program; // residual to the next coarser level
+    gfx::Program prolongate_program; // correction from the next coarser level
+
+    void init(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max) {
+        this->grid_dimensions = grid_dimensions;
+        this->bounds_min = bounds_min;
+        this->bounds_max = bounds_max;
+
+        levels.clear();
+        int data_size = 0;
+        int type_size = 0;
+        glm::ivec3 dim = grid_dimensions;
+        while (true) {
+            const int size = dim.x * dim.y * dim.z;
+            levels.push_back({dim, size, data_size, data_size + size, type_size});
+            data_size += 2 * size;
+            type_size += size;
+            if (glm::compMin(dim) <= coarsest_size)
+                break;
+            dim = (dim + glm::ivec3(1)) / 2;
+        }
+        const int n = levels[0].size;
+        x_offset = data_size;
+        s_offset = data_size + n;
+        q_offset = data_size + 2 * n;
+        data_size += 3 * n;
+
+        data_ssbo.bind_base(4).set_data(std::vector<float>(data_size), GL_DYNAMIC_COPY);
+        type_ssbo.bind_base(5).set_data(std::vector<int>(type_size), GL_DYNAMIC_COPY);
+        scalar_ssbo.bind_base(6).set_data(std::vector<float>(scalar_partials + max_groups), GL_DYNAMIC_COPY);
+
+        init_program.compute({"common.glsl", "pcg_common.glsl", "pcg_init.cs.glsl"}).compile();
+        apply_a_program.compute({"common.glsl", "pcg_common.glsl", "pcg_apply_a.cs.glsl"}).compile();
+        dot_program.compute({"common.glsl", "pcg_common.glsl", "pcg_dot.cs.glsl"}).compile();
+        reduce_program.compute({"common.glsl", "pcg_common.glsl", "pcg_reduce.cs.glsl"}).compile();
+        update_pressure_program.compute({"common.glsl", "pcg_common.glsl", "pcg_update_pressure.cs.glsl"}).compile();
+        update_search_program.compute({"common.glsl", "pcg_common.glsl", "pcg_update_search.cs.glsl"}).compile();
+        finalize_program.compute({"common.glsl", "pcg_common.glsl", "pcg_finalize.cs.glsl"}).compile();
+        precondition_program.compute({"common.glsl", "pcg_common.glsl", "pcg_precondition.cs.glsl"}).compile();
+        init_types_program.compute({"common.glsl", "pcg_common.glsl", "mg_init_types.cs.glsl"}).compile();
+        restrict_type_program.compute({"common.glsl", "pcg_common.glsl", "mg_restrict_type.cs.glsl"}).compile();
+        smooth_program.compute({"common.glsl", "pcg_common.glsl", "mg_smooth.cs.glsl"}).compile();
+        restrict_program.compute({"common.glsl", "pcg_common.glsl", "mg_restrict.cs.glsl"}).compile();
+        prolongate_program.compute({"common.glsl", "pcg_common.glsl", "mg_prolongate.cs.glsl"}).compile();
+    }
+
+    void solve(float dt) {
+        // level 0 operator scale, as in build_a; each coarser level doubles the cell size
+        const glm::vec3 cell_size = (bounds_max - bounds_min) / glm::vec3(grid_dimensions - glm::ivec3(1));
+        scale = dt / (cell_size * cell_size); // density is 1, see common.glsl
+
+        // cell types of the hierarchy
+        use(init_types_program, 0);
+        dispatch(levels[0].size);
+        for (size_t l = 1; l < levels.size(); ++l) {
+            use(restrict_type_program, l);
+            glUniform3iv(restrict_type_program.uniform_loc("fine_dim"), 1, glm::value_ptr(levels[l - 1].dim));
+            glUniform1i(restrict_type_program.uniform_loc("fine_type_offset"), levels[l - 1].type_offset);
+            dispatch(levels[l].size);
+        }
+
+        // x = pressure_guess, r = b - Ax, and the convergence threshold from b (held in q)
+        const Level& fine = levels[0];
+        use(init_program, 0);
+        glUniform1i(init_program.uniform_loc("x_offset"), x_offset);
+        glUniform1i(init_program.uniform_loc("b_offset"), q_offset);
+        dispatch(fine.size);
+        apply_a(x_offset, fine.b_offset, true);
+        reduce(q_offset, q_offset, scalar_threshold, true, tolerance);
+        reduce(fine.b_offset, fine.b_offset, scalar_residual, true);
+        const float zero = 0;
+        scalar_ssbo.bind();
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, scalar_iterations * sizeof(float), sizeof(float), &zero);
+        scalar_ssbo.unbind();
+
+        // z = M^-1 r, s = z
+        apply_preconditioner();
+        reduce(fine.x_offset, fine.b_offset, scalar_rho);
+        update_search(scalar_rho, -1);
+
+        bool done = read_scalars();
+        for (int i = 0; i < max_iterations and !done; ++i) {
+            const int rho_slot = scalar_rho + i % 2;
+            const int next_rho_slot = scalar_rho + (i + 1) % 2;
+
+            apply_a(s_offset, q_offset, false);
+            reduce(s_offset, q_offset, scalar_sq);
+
+            use(update_pressure_program, 0);
+            glUniform1i(update_pressure_program.uniform_loc("x_offset"), x_offset);
+            glUniform1i(update_pressure_program.uniform_loc("r_offset"), fine.b_offset);
+            glUniform1i(update_pressure_program.uniform_loc("s_offset"), s_offset);
+            glUniform1i(update_pressure_program.uniform_loc("q_offset"), q_offset);
+            glUniform1i(update_pressure_program.uniform_loc("rho_slot"), rho_slot);
+            dispatch(fine.size);
+            reduce(fine.b_offset, fine.b_offset, scalar_residual, true);
+
+            if ((i + 1) % check_interval == 0 or i == max_iterations - 1) {
+                done = read_scalars();
+                if (done or i == max_iterations - 1)
+                    break;
+            }
+            apply_preconditioner();
+            reduce(fine.x_offset, fine.b_offset, next_rho_slot);
+            update_search(next_rho_slot, rho_slot);
+        }
+
+        use(finalize_program, 0);
+        glUniform1i(finalize_program.uniform_loc("x_offset"), x_offset);
+        dispatch(fine.size);
+        finalize_program.disuse();
+    }
+
+private:
+    glm::vec3 scale{0}; // off-diagonal magnitude of the level 0 operator along each axis
+
+    static int num_groups(int n) {
+        return std::clamp((n + group_size - 1) / group_size, 1, max_groups);
+    }
+
+    /**
+     * Use a solver program, with the uniforms describing level l.
+     */
+    void use(gfx::Program& program, int l) {
+        program.use();
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+        glUniform1i(program.uniform_loc("level"), l);
+        glUniform3iv(program.uniform_loc("level_dim"), 1, glm::value_ptr(levels[l].dim));
+        glUniform1i(program.uniform_loc("type_offset"), levels[l].type_offset);
+        const glm::vec3 level_scale = scale / static_cast<float>(1 << (2 * l));
+        glUniform3fv(program.uniform_loc("level_scale"), 1, glm::value_ptr(level_scale));
+    }
+
+    void dispatch(int n) {
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glDispatchCompute(num_groups(n), 1, 1);
+    }
+
+    void apply_a(int x, int out, bool residual) {
+        use(apply_a_program, 0);
+        glUniform1i(apply_a_program.uniform_loc("x_offset"), x);
+        glUniform1i(apply_a_program.uniform_loc("out_offset"), out);
+        glUniform1i(apply_a_program.uniform_loc("residual"), residual);
+        dispatch(levels[0].size);
+    }
+
+    /**
+     * Write scale * dot(a, b), or scale * max |a|, to a scalar slot.
+     */
+    void reduce(int a, int b, int slot, bool max_norm = false, float scale = 1) {
+        use(dot_program, 0);
+        glUniform1i(dot_program.uniform_loc("a_offset"), a);
+        glUniform1i(dot_program.uniform_loc("b_offset"), b);
+        glUniform1i(dot_program.uniform_loc("max_norm"), max_norm);
+        dispatch(levels[0].size);
+
+        reduce_program.use();
+        glUniform1i(reduce_program.uniform_loc("num_partials"), num_groups(levels[0].size));
+        glUniform1i(reduce_program.uniform_loc("slot"), slot);
+        glUniform1i(reduce_program.uniform_loc("max_norm"), max_norm);
+        glUniform1f(reduce_program.uniform_loc("scale"), scale);
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glDispatchCompute(1, 1, 1);
+    }
+
+    /**
+     * Read the residual and iteration count back; returns true if converged.
+     */
+    bool read_scalars() {
+        float scalars[scalar_partials];
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        scalar_ssbo.bind();
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(scalars), scalars);
+        scalar_ssbo.unbind();
+        residual = scalars[scalar_residual];
+        iterations = scalars[scalar_iterations];
+        return residual <= scalars[scalar_threshold];
+    }
+
+    void update_search(int rho_slot, int previous_rho_slot) {
+        use(update_search_program, 0);
+        glUniform1i(update_search_program.uniform_loc("s_offset"), s_offset);
+        glUniform1i(update_search_program.uniform_loc("z_offset"), levels[0].x_offset);
+        glUniform1i(update_search_program.uniform_loc("rho_slot"), rho_slot);
+        glUniform1i(update_search_program.uniform_loc("previous_rho_slot"), previous_rho_slot);
+        dispatch(levels[0].size);
+    }
+
+    void smooth(int l, int color, bool zero_guess = false) {
+        use(smooth_program, l);
+        glUniform1i(smooth_program.uniform_loc("x_offset"), levels[l].x_offset);
+        glUniform1i(smooth_program.uniform_loc("b_offset"), levels[l].b_offset);
+        glUniform1i(smooth_program.uniform_loc("color"), color);
+        glUniform1i(smooth_program.uniform_loc("zero_guess"), zero_guess);
+        dispatch(levels[l].size);
+    }
+
+    /**
+     * z = M^-1 r.
+     */
+    void apply_preconditioner() {
+        if (preconditioner != Preconditioner::MULTIGRID) {
+            use(precondition_program, 0);
+            glUniform1i(precondition_program.uniform_loc("r_offset"), levels[0].b_offset);
+            glUniform1i(precondition_program.uniform_loc("z_offset"), levels[0].x_offset);
+            glUniform1i(precondition_program.uniform_loc("diagonal"), preconditioner == Preconditioner::JACOBI);
+            dispatch(levels[0].size);
+            return;
+        }
+
+        // one V-cycle, starting from z = 0
+        const int coarsest = levels.size() - 1;
+        for (int l = 0; l < coarsest; ++l) {
+            for (int i = 0; i < smooth_sweeps; ++i) {
+                smooth(l, 0, l == 0 and i == 0);
+                smooth(l, 1);
+            }
+
+            use(restrict_program, l);
+            glUniform1i(restrict_program.uniform_loc("x_offset"), levels[l].x_offset);
+            glUniform1i(restrict_program.uniform_loc("b_offset"), levels[l].b_offset);
+            glUniform3iv(restrict_program.uniform_loc("coarse_dim"), 1, glm::value_ptr(levels[l + 1].dim));
+            glUniform1i(restrict_program.uniform_loc("coarse_x_offset"), levels[l + 1].x_offset);
+            glUniform1i(restrict_program.uniform_loc("coarse_b_offset"), levels[l + 1].b_offset);
+            glUniform1f(restrict_program.uniform_loc("restrict_scale"), restrict_scale);
+            dispatch(levels[l + 1].size);
+        }
+
+        for (int i = 0; i < coarse_sweeps; ++i) {
+            smooth(coarsest, 0, coarsest == 0 and i == 0);
+            smooth(coarsest, 1);
+        }
+        for (int i = 0; i < coarse_sweeps; ++i) {
+            smooth(coarsest, 1);
+            smooth(coarsest, 0);
+        }
+
+        for (int l = coarsest - 1; l >= 0; --l) {
+            use(prolongate_program, l);
+            glUniform1i(prolongate_program.uniform_loc("x_offset"), levels[l].x_offset);
+            glUniform3iv(prolongate_program.uniform_loc("coarse_dim"), 1, glm::value_ptr(levels[l + 1].dim));
+            glUniform1i(prolongate_program.uniform_loc("coarse_x_offset"), levels[l + 1].x_offset);
+            dispatch(levels[l].size);
+
+            for (int i = 0; i < smooth_sweeps; ++i) {
+                smooth(l, 1);
+                smooth(l, 0);
+            }
+        }
+    }
+};
@@ -0,0 +1,330 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "gfx/object.hpp"
+#include "CompactParticle.hpp"
+#include "Fluid.hpp"
+#include "FluidExtent.hpp"
+#include "FrameScheduler.hpp"
+
+/**
+ * Runs a Fluid's simulation on a worker thread, on its own GL context shared
+ * with the drawing context, so rendering doesn't wait for simulation steps.
+ *
+ * After every batch of frames the worker copies the particles and their count
+ * into one of two snapshot buffers and fences the copy. The drawing thread
+ * calls acquire() before drawing the fluid, which switches to the newest
+ * snapshot once its fence has signaled (without waiting for it), and release()
+ * after, which fences the draws so the worker doesn't overwrite a snapshot
+ * that is still being drawn. The drawing thread never blocks on the simulation;
+ * it draws the last completed frame until the next one is done.
+ *
+ * Simulation inputs from the drawing thread (camera, mouse, PIC/FLIP blend,
+ * pausing and resets) go through set_controls(); the Fluid's simulation
+ * members must not be touched by other threads while the worker runs.
+ */
+class SimulationThread {
+public:
+    // simulation inputs, applied before every batch of frames
+    struct Controls {
+        bool running = false; // simulate in real time
+        FrameScheduler::Mode mode = FrameScheduler::Mode::REAL_TIME;
+        glm::vec3 eye{0};
+        glm::vec3 world_mouse_pos{0};
+        glm::vec3 world_mouse_vel{0};
+        float pic_flip_blend = 0.9;
+    };
+
+    FrameScheduler scheduler; // frames of fluid.dt, owned by the worker once started
+
+    /**
+     * make_current makes a context shared with the drawing context current on
+     * the calling (worker) thread; release_current undoes it when the worker
+     * exits.
+     */
+    SimulationThread(Fluid& fluid, std::function<void()> make_current, std::function<void()> release_current)
+        : fluid(fluid), make_current(std::move(make_current)), release_current(std::move(release_current)) {
+        scheduler.frame_time = fluid.dt;
+    }
+
+    ~SimulationThread() {
+        stop();
+        for (GLsync& fence : copy_fences) { delete_fence(fence); }
+        for (GLsync& fence : draw_fences) { delete_fence(fence); }
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    /**
+     * Start the worker, which runs fluid.init_simulation() on its context and
+     * returns once that's done (shader compilation isn't thread safe, see
+     * gfx::shader_prepend). fluid.init_rendering() is left to the caller.
+     */
+    void start() {
+        std::unique_lock<std::mutex> lock(mutex);
+        worker = std::thread(&SimulationThread::run, this);
+        changed.wait(lock, [&]() { return initialized or error; });
+        if (error) {
+            lock.unlock();
+            stop();
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * Stop the worker after its current batch of frames.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void set_controls(const Controls& controls) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->controls = controls;
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * Simulate n more frames regardless of running, e.g. single steps while paused.
+     */
+    void request_frames(int n) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested_frames += n;
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * Reseed the particles and grid (Fluid::init_ssbos(), which overwrites the
+     * simulation buffers in place) before the next frame.
+     */
+    void request_reset() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reset = true;
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * Frames simulated so far.
+     */
+    long frames() const {
+        return simulated_frames;
+    }
+
+    /**
+     * Point the fluid's draws at the newest completed snapshot. Call on the
+     * drawing context before drawing the particles; rethrows errors of the
+     * worker.
+     */
+    void acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if (published >= 0) {
+                const GLenum status = glClientWaitSync(copy_fences[published], 0, 0);
+                if (status == GL_ALREADY_SIGNALED or status == GL_CONDITION_SATISFIED) {
+                    front = published;
+                    published = -1;
+                    ++swaps;
+                }
+            }
+        }
+        fluid.set_draw_particles(snapshots[front], extent_snapshots[front]);
+    }
+
+    /**
+     * Fence the draws of the current snapshot. Call on the drawing context
+     * after drawing the particles.
+     */
+    void release() {
+        const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // so the worker's wait on the fence can finish
+        std::lock_guard<std::mutex> lock(mutex);
+        delete_fence(draw_fences[front]);
+        draw_fences[front] = fence;
+    }
+
+    /**
+     * Snapshots the drawing thread switched to so far.
+     */
+    long snapshots_drawn() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return swaps;
+    }
+
+private:
+    Fluid& fluid;
+    std::function<void()> make_current;
+    std::function<void()> release_current;
+    std::thread worker;
+
+    // particles and extent (for the particle count) of two completed frames
+    gfx::Buffer snapshots[2]{gfx::Buffer{GL_SHADER_STORAGE_BUFFER}, gfx::Buffer{GL_SHADER_STORAGE_BUFFER}};
+    gfx::Buffer extent_snapshots[2]{gfx::Buffer{GL_SHADER_STORAGE_BUFFER}, gfx::Buffer{GL_SHADER_STORAGE_BUFFER}};
+
+    // shared with the worker, under mutex
+    std::mutex mutex;
+    std::condition_variable changed;
+    Controls controls;
+    int requested_frames = 0;
+    bool reset = false;
+    bool stopping = false;
+    bool initialized = false;
+    std::exception_ptr error;
+    int front = 0; // snapshot being drawn
+    int published = -1; // completed snapshot newer than front, or -1
+    long swaps = 0;
+    GLsync copy_fences[2]{}; // signaled when the worker's copy into each snapshot is done
+    GLsync draw_fences[2]{}; // signaled when the draws of each snapshot are done
+
+    std::atomic<long> simulated_frames{0};
+
+    static void delete_fence(GLsync& fence) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    void run() {
+        try {
+            make_current();
+            fluid.eager_cpu_grid = true; // the drawing thread can't read cpu_sim
+            fluid.init_simulation();
+            allocate_snapshots();
+            copy_snapshot(front);
+            glFinish(); // the first snapshot is complete before anything draws it
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                initialized = true;
+            }
+            changed.notify_all();
+            simulate();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+        }
+        changed.notify_all();
+        release_current();
+    }
+
+    void allocate_snapshots() {
+        for (int i = 0; i < 2; ++i) {
+            snapshots[i].allocate<GpuParticle>(fluid.particle_ssbo.length(), GL_STREAM_COPY);
+            extent_snapshots[i].allocate<FluidExtent::Extent>(1, GL_STREAM_COPY);
+        }
+    }
+
+    void copy_snapshot(int i) {
+        fluid.ssbo_barrier();
+        copy_buffer(fluid.particle_ssbo, snapshots[i]);
+        copy_buffer(fluid.fluid_extent.extent_ssbo, extent_snapshots[i]);
+    }
+
+    static void copy_buffer(const gfx::Buffer& from, const gfx::Buffer& to) {
+        glBindBuffer(GL_COPY_READ_BUFFER, from.id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, to.id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, std::min(from.size(), to.size()));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void simulate() {
+        using clock = std::chrono::steady_clock;
+        const auto start_time = clock::now();
+        auto now = [&]() { return std::chrono::duration<double>(clock::now() - start_time).count(); };
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            // wait until there is something to do
+            if (!controls.running and requested_frames == 0 and !reset) {
+                scheduler.reset();
+                changed.wait(lock);
+                continue;
+            }
+
+            const Controls frame_controls = controls;
+            const bool do_reset = reset;
+            reset = false;
+            scheduler.mode = frame_controls.mode;
+            int frames = frame_controls.running ? scheduler.frames_due(now()) : 0;
+            if (requested_frames > 0) {
+                frames = std::max(frames, 1);
+                requested_frames = std::max(requested_frames - frames, 0);
+            }
+            if (frames == 0 and !do_reset) {
+                // sleep until the next frame is due, or the controls change
+                changed.wait_for(lock, std::chrono::duration<double>(scheduler.frame_time - scheduler.accumulator));
+                continue;
+            }
+            lock.unlock();
+
+            fluid.eye = frame_controls.eye;
+            fluid.world_mouse_pos = frame_controls.world_mouse_pos;
+            fluid.world_mouse_vel = frame_controls.world_mouse_vel;
+            fluid.pic_flip_blend = frame_controls.pic_flip_blend;
+            if (do_reset) {
+                fluid.init_ssbos();
+            }
+            for (int i = 0; i < frames; ++i) {
+                fluid.step_frame();
+                ++simulated_frames;
+            }
+            publish();
+
+            lock.lock();
+        }
+    }
+
+    /**
+     * Copy the particles into the snapshot not being drawn and hand it to the
+     * drawing thread once the copy is done.
+     */
+    void publish() {
+        GLsync draw_fence;
+        int target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            target = 1 - front;
+            if (published == target) {
+                published = -1; // about to be overwritten; front stays until the new copy is done
+            }
+            draw_fence = draw_fences[target];
+            draw_fences[target] = nullptr;
+        }
+        if (draw_fence) {
+            glWaitSync(draw_fence, 0, GL_TIMEOUT_IGNORED); // the last draws of it are done
+            glDeleteSync(draw_fence);
+        }
+        copy_snapshot(target);
+        const GLsync copy_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // so the drawing thread sees the fence signal
+        std::lock_guard<std::mutex> lock(mutex);
+        delete_fence(copy_fences[target]);
+        copy_fences[target] = copy_fence;
+        published = target;
+    }
+};
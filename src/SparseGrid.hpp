@@ -0,0 +1,129 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include "gfx/object.hpp"
+#include "gfx/program.hpp"
+
+/**
+ * Active brick list for running the grid kernels over the fluid only.
+ *
+ * The grid is split into bricks of brick_size^3 cells. Every step, update()
+ * marks the bricks within two cells of a particle, lists the bricks marked this
+ * step or the step before in active_brick (common.glsl), and writes an indirect
+ * dispatch covering their tiles. Grid kernels compiled with SPARSE_GRID map
+ * their workgroups to those tiles (see grid_tile.glsl) and are launched with
+ * dispatch(), so their cost follows the fluid volume instead of the grid's.
+ *
+ * Storage stays dense: cells outside the active bricks keep the values of the
+ * last step they were active in, which is the empty grid state because a brick
+ * stays active for one step after its particles leave.
+ */
+struct SparseGrid {
+    constexpr static int brick_size = 8; // BRICK_SIZE in common.glsl
+    constexpr static int list_group_size = 256; // local_size_x in brick_list.cs.glsl
+    constexpr static int max_bricks_per_axis = 1024; // see pack_brick_coord in common.glsl
+    constexpr static GLuint was_occupied = 2; // BRICK_WAS_OCCUPIED in brick_common.glsl
+
+    struct Header {
+        GLuint groups_x;
+        GLuint groups_y;
+        GLuint groups_z;
+        GLuint num_active_bricks;
+    };
+
+    glm::ivec3 grid_dimensions{0};
+    glm::vec3 bounds_min{0};
+    glm::vec3 bounds_max{0};
+    glm::ivec3 brick_dimensions{0};
+    int num_bricks = 0;
+    int tiles_per_brick = 0;
+    int particle_group_size = 256;
+
+    gfx::Buffer brick_ssbo{GL_SHADER_STORAGE_BUFFER}; // Header followed by the active brick list
+    gfx::Buffer state_ssbo{GL_SHADER_STORAGE_BUFFER}; // occupancy of every brick
+
+    gfx::Program mark_program; // mark the bricks around each particle
+    gfx::Program list_program; // list the marked bricks
+    gfx::Program dispatch_program; // size the indirect dispatch
+
+    void init(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max, const glm::ivec3& tile_size, int particle_group_size) {
+        if (glm::any(glm::notEqual(glm::ivec3(brick_size) % tile_size, glm::ivec3(0)))) {
+            throw std::runtime_error("The sparse grid needs a tile size that divides the brick size of " + std::to_string(brick_size) + ".");
+        }
+        this->grid_dimensions = grid_dimensions;
+        this->bounds_min = bounds_min;
+        this->bounds_max = bounds_max;
+        this->particle_group_size = particle_group_size;
+        brick_dimensions = (grid_dimensions + glm::ivec3(brick_size - 1)) / brick_size;
+        num_bricks = glm::compMul(brick_dimensions);
+        tiles_per_brick = glm::compMul(glm::ivec3(brick_size) / tile_size);
+        if (glm::compMax(brick_dimensions) > max_bricks_per_axis) {
+            throw std::runtime_error("The sparse grid supports at most " + std::to_string(max_bricks_per_axis) + " bricks along each axis.");
+        }
+
+        std::vector<GLuint> bricks(sizeof(Header) / sizeof(GLuint) + num_bricks, 0);
+        brick_ssbo.bind_base(15).set_data(bricks, GL_DYNAMIC_COPY);
+        // every brick was occupied before the first step, so it covers the whole grid once
+        state_ssbo.bind_base(16).set_data(std::vector<GLuint>(num_bricks, was_occupied), GL_DYNAMIC_COPY);
+
+        mark_program.define("PARTICLE_GROUP_SIZE", std::to_string(particle_group_size)).compute({"common.glsl", "brick_common.glsl", "particle_group.glsl", "brick_mark.cs.glsl"}).compile();
+        list_program.compute({"common.glsl", "brick_common.glsl", "brick_list.cs.glsl"}).compile();
+        dispatch_program.compute({"common.glsl", "brick_common.glsl", "brick_dispatch.cs.glsl"}).compile();
+    }
+
+    /**
+     * Rebuild the active brick list from the num_particles particles bound to
+     * binding 0.
+     */
+    void update(int num_particles) {
+        brick_ssbo.bind();
+        const Header cleared{0, 0, 0, 0};
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Header), &cleared);
+        brick_ssbo.unbind();
+
+        use(mark_program);
+        dispatch_compute((num_particles + particle_group_size - 1) / particle_group_size);
+        use(list_program);
+        dispatch_compute((num_bricks + list_group_size - 1) / list_group_size);
+        use(dispatch_program);
+        glUniform1ui(dispatch_program.uniform_loc("tiles_per_brick"), tiles_per_brick);
+        dispatch_compute(1);
+        dispatch_program.disuse();
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    }
+
+    /**
+     * Launch the bound grid kernel over the tiles of the active bricks.
+     */
+    void dispatch() {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, brick_ssbo.id);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+
+    /**
+     * Read back the number of active bricks (synchronizes with the GPU).
+     */
+    int active_bricks() {
+        const auto header = brick_ssbo.map_buffer_readonly<Header>();
+        return header[0].num_active_bricks;
+    }
+
+private:
+    void use(gfx::Program& program) {
+        program.use();
+        glUniform3fv(program.uniform_loc("bounds_min"), 1, glm::value_ptr(bounds_min));
+        glUniform3fv(program.uniform_loc("bounds_max"), 1, glm::value_ptr(bounds_max));
+        glUniform3iv(program.uniform_loc("grid_dim"), 1, glm::value_ptr(grid_dimensions));
+    }
+
+    void dispatch_compute(int groups) {
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        glDispatchCompute(groups, 1, 1);
+    }
+};
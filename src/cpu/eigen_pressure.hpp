@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Sparse>
+#include <eigen3/Eigen/SparseCholesky>
+#include "../GridCell.hpp"
+#include "grid_geometry.hpp"
+
+namespace cpu {
+/**
+ * Pressure solve with Eigen, reusing as much work as possible across steps.
+ *
+ * Only fluid cells with a nonzero diagonal are unknowns. The sparse matrix is
+ * assembled only when the set of unknowns (hashed over the grid) changes; on
+ * other steps its values are refreshed in place from a_diag/a_x/a_y/a_z, and
+ * if they didn't change either, the previous factorization is reused as-is.
+ * Systems with at most direct_max_unknowns unknowns are solved directly with
+ * SimplicialLDLT (whose symbolic analysis is also kept for the lifetime of a
+ * pattern); larger ones use conjugate gradient, warm started from the previous
+ * solution.
+ */
+class EigenPressureSolver {
+public:
+    using Matrix = Eigen::SparseMatrix<float>;
+
+    int direct_max_unknowns = 8000; // 0 always uses conjugate gradient
+    float tolerance = 1e-5; // conjugate gradient relative residual
+
+    // statistics for the last solve
+    bool pattern_rebuilt = false;
+    bool refactorized = false;
+    int iterations = 0; // conjugate gradient iterations, 0 for the direct solver
+
+    int num_unknowns() const {
+        return cells.size();
+    }
+
+    /**
+     * Solve for pressure, which is written to every grid cell (0 outside the fluid).
+     */
+    void solve(const GridGeometry& geom, GridCell* grid) {
+        const int n = geom.num_cells();
+        const std::uint64_t hash = hash_mask(grid, n);
+        pattern_rebuilt = hash != mask_hash or n != static_cast<int>(unknown_index.size());
+        if (pattern_rebuilt) {
+            mask_hash = hash;
+            build_pattern(geom, grid);
+        }
+
+        refactorized = update_values(grid) or pattern_rebuilt;
+        if (pattern_rebuilt)
+            ldlt_analyzed = false;
+        if (refactorized) {
+            ldlt_ready = false;
+            cg_ready = false;
+        }
+        iterations = 0;
+
+        Eigen::VectorXf b(cells.size());
+        for (int k = 0; k < num_unknowns(); ++k) {
+            b(k) = grid[cells[k]].rhs;
+        }
+
+        bool direct = num_unknowns() <= direct_max_unknowns;
+        if (direct) {
+            if (!ldlt_analyzed) {
+                ldlt.analyzePattern(A);
+                ldlt_analyzed = true;
+            }
+            if (!ldlt_ready) {
+                ldlt.factorize(A);
+                ldlt_ready = true;
+            }
+            // singular systems (fluid with no free surface) fall back to conjugate gradient
+            direct = ldlt.info() == Eigen::Success;
+            if (direct)
+                solution = ldlt.solve(b);
+        }
+        if (!direct and num_unknowns() > 0) {
+            cg.setTolerance(tolerance);
+            if (!cg_ready) {
+                cg.compute(A);
+                cg_ready = true;
+            }
+            if (pattern_rebuilt or solution.size() != b.size())
+                solution = Eigen::VectorXf::Zero(b.size());
+            solution = cg.solveWithGuess(b, solution);
+            iterations = cg.iterations();
+            if (cg.info() != Eigen::Success)
+                throw std::runtime_error("Didn't converge");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            grid[i].pressure = unknown_index[i] >= 0 ? solution(unknown_index[i]) : 0;
+        }
+    }
+
+private:
+    enum Coefficient { DIAG, A_X, A_Y, A_Z };
+
+    struct ValueSource {
+        int cell;
+        Coefficient coefficient;
+    };
+
+    std::uint64_t mask_hash = 0;
+    std::vector<int> cells; // grid index of each unknown
+    std::vector<int> unknown_index; // unknown of each grid cell, or -1
+    std::vector<ValueSource> value_sources; // where each entry of A.valuePtr() comes from
+    Matrix A;
+    Eigen::VectorXf solution;
+    Eigen::SimplicialLDLT<Matrix> ldlt;
+    Eigen::ConjugateGradient<Matrix, Eigen::Lower | Eigen::Upper, Eigen::DiagonalPreconditioner<float>> cg;
+    bool ldlt_analyzed = false; // ldlt has analyzed the current pattern of A
+    bool ldlt_ready = false; // ldlt has factorized the current values of A
+    bool cg_ready = false; // cg has been computed for the current values of A
+
+    static bool is_unknown(const GridCell& cell) {
+        return cell.type == GRID_FLUID and cell.a_diag != 0;
+    }
+
+    static std::uint64_t hash_mask(const GridCell* grid, int n) {
+        // FNV-1a over one bit per cell, packed into bytes
+        std::uint64_t hash = 14695981039346656037ull;
+        for (int i = 0; i < n; i += 8) {
+            unsigned char bits = 0;
+            for (int j = i; j < i + 8 and j < n; ++j) {
+                bits = (bits << 1) | is_unknown(grid[j]);
+            }
+            hash = (hash ^ bits) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static float coefficient_value(const GridCell& cell, Coefficient coefficient) {
+        switch (coefficient) {
+            case A_X: return cell.a_x;
+            case A_Y: return cell.a_y;
+            case A_Z: return cell.a_z;
+            default: return cell.a_diag;
+        }
+    }
+
+    void build_pattern(const GridGeometry& geom, const GridCell* grid) {
+        const glm::ivec3& dim = geom.grid_dimensions;
+        const int n = geom.num_cells();
+        const int strides[3] = {1, dim.x, dim.x * dim.y};
+
+        cells.clear();
+        unknown_index.assign(n, -1);
+        for (int i = 0; i < n; ++i) {
+            if (is_unknown(grid[i])) {
+                unknown_index[i] = cells.size();
+                cells.push_back(i);
+            }
+        }
+
+        // both halves of each off-diagonal pair come from the lower cell's a_x/a_y/a_z
+        std::vector<Eigen::Triplet<float>> triplets;
+        for (int k = 0; k < num_unknowns(); ++k) {
+            const int i = cells[k];
+            const glm::ivec3 c = geom.get_grid_coord_from_index(i);
+            triplets.emplace_back(k, k, grid[i].a_diag);
+            for (int axis = 0; axis < 3; ++axis) {
+                if (c[axis] >= dim[axis] - 2)
+                    continue;
+                const int neighbor = unknown_index[i + strides[axis]];
+                const float a = coefficient_value(grid[i], static_cast<Coefficient>(A_X + axis));
+                if (neighbor < 0)
+                    continue;
+                triplets.emplace_back(k, neighbor, a);
+                triplets.emplace_back(neighbor, k, a);
+            }
+        }
+        A.resize(num_unknowns(), num_unknowns());
+        A.setFromTriplets(triplets.begin(), triplets.end());
+        A.makeCompressed();
+
+        value_sources.clear();
+        value_sources.reserve(A.nonZeros());
+        for (int col = 0; col < A.outerSize(); ++col) {
+            for (Matrix::InnerIterator it(A, col); it; ++it) {
+                const int row_cell = cells[it.row()];
+                const int col_cell = cells[it.col()];
+                const int lower = std::min(row_cell, col_cell);
+                const int offset = std::abs(row_cell - col_cell);
+                Coefficient coefficient = DIAG;
+                if (offset == strides[0])
+                    coefficient = A_X;
+                else if (offset == strides[1])
+                    coefficient = A_Y;
+                else if (offset == strides[2])
+                    coefficient = A_Z;
+                value_sources.push_back({lower, coefficient});
+            }
+        }
+    }
+
+    /**
+     * Copy coefficients from the grid into A; returns true if any changed.
+     */
+    bool update_values(const GridCell* grid) {
+        float* values = A.valuePtr();
+        bool changed = false;
+        for (size_t k = 0; k < value_sources.size(); ++k) {
+            const float value = coefficient_value(grid[value_sources[k].cell], value_sources[k].coefficient);
+            changed |= values[k] != value;
+            values[k] = value;
+        }
+        return changed;
+    }
+};
+}
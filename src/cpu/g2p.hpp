@@ -0,0 +1,303 @@
+#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "../GridCell.hpp"
+#include "../Particle.hpp"
+#include "grid_geometry.hpp"
+#include "thread_pool.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_G2P_X86 1
+#include <immintrin.h>
+#endif
+
+namespace cpu {
+/**
+ * Grid-to-particle velocity transfer (PIC/FLIP blend), mirroring
+ * grid_to_particle.glsl.
+ *
+ * On x86 the per-particle trilinear gathers run 8 particles at a time with
+ * AVX2 gathers, or 4 at a time with SSE4.1; the widest kernel the CPU
+ * supports is picked at runtime, with a scalar kernel as the fallback and for
+ * leftover particles.
+ */
+class GridToParticle {
+public:
+    struct Params {
+        const GridGeometry& geom;
+        const GridCell* grid;
+        Particle* particles;
+        float pic_flip_blend;
+    };
+
+    using Kernel = void (*)(const Params&, int begin, int end);
+
+    enum class Isa { SCALAR, SSE41, AVX2 };
+
+    /**
+     * Widest instruction set supported by both this build and the running CPU.
+     */
+    static Isa detect_isa() {
+#ifdef FLUID_G2P_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Isa::SSE41;
+#endif
+        return Isa::SCALAR;
+    }
+
+    static const char* isa_name(Isa isa) {
+        switch (isa) {
+            case Isa::AVX2: return "AVX2";
+            case Isa::SSE41: return "SSE4.1";
+            default: return "scalar";
+        }
+    }
+
+    static Kernel get_kernel(Isa isa) {
+#ifdef FLUID_G2P_X86
+        if (isa == Isa::AVX2)
+            return kernel_avx2;
+        if (isa == Isa::SSE41)
+            return kernel_sse41;
+#endif
+        return kernel_scalar;
+    }
+
+    Isa isa = detect_isa();
+
+    void run(ThreadPool& pool, const GridGeometry& geom, const GridCell* grid, Particle* particles, int num_particles, float pic_flip_blend) const {
+        const Params params{geom, grid, particles, pic_flip_blend};
+        const Kernel kernel = get_kernel(isa);
+        pool.parallel_for_range(0, num_particles, [&](int lo, int hi, int) {
+            kernel(params, lo, hi);
+        });
+    }
+
+    static void kernel_scalar(const Params& params, int begin, int end) {
+        const GridGeometry& geom = params.geom;
+
+        auto lerp = [&](const glm::vec3& pos, int axis, const glm::vec3 GridCell::* field) {
+            // interpolates one velocity component from 8 nearby grid corners
+            glm::ivec3 component(0);
+            component[axis] = 1;
+            const glm::ivec3 dimension_offset = glm::ivec3(1) - component;
+            const glm::ivec3 base_coord = geom.get_grid_coord(pos, -dimension_offset);
+            const glm::vec3 weights = (pos - geom.get_world_coord(base_coord, dimension_offset)) / geom.cell_size;
+
+            auto at = [&](const glm::ivec3& offset) {
+                return (params.grid[geom.get_grid_index(geom.offset_clamped(base_coord, offset))].*field)[axis];
+            };
+
+            // x interpolation (gets values from all 8 grid corners)
+            const float vel_x1 = at({0, 0, 0}) * (1 - weights.x) + at({1, 0, 0}) * weights.x;
+            const float vel_x2 = at({0, 1, 0}) * (1 - weights.x) + at({1, 1, 0}) * weights.x;
+            const float vel_x3 = at({0, 0, 1}) * (1 - weights.x) + at({1, 0, 1}) * weights.x;
+            const float vel_x4 = at({0, 1, 1}) * (1 - weights.x) + at({1, 1, 1}) * weights.x;
+
+            // y interpolation
+            const float vel_y1 = vel_x1 * (1 - weights.y) + vel_x2 * weights.y;
+            const float vel_y2 = vel_x3 * (1 - weights.y) + vel_x4 * weights.y;
+
+            // z interpolation
+            return vel_y1 * (1 - weights.z) + vel_y2 * weights.z;
+        };
+
+        const float blend = params.pic_flip_blend;
+        for (int i = begin; i < end; ++i) {
+            Particle& p = params.particles[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                const float vel = lerp(p.pos, axis, &GridCell::vel);
+                const float old_vel = lerp(p.pos, axis, &GridCell::old_vel);
+                const float flip = p.vel[axis] + vel - old_vel;
+                p.vel[axis] = vel * (1 - blend) + flip * blend;
+            }
+        }
+    }
+
+private:
+    static constexpr int cell_floats = sizeof(GridCell) / sizeof(float);
+    static constexpr int particle_floats = sizeof(Particle) / sizeof(float);
+    static constexpr int vel_offset = offsetof(GridCell, vel) / sizeof(float);
+    static constexpr int old_vel_offset = offsetof(GridCell, old_vel) / sizeof(float);
+    static constexpr int pos_offset = offsetof(Particle, pos) / sizeof(float);
+    static constexpr int particle_vel_offset = offsetof(Particle, vel) / sizeof(float);
+
+    static_assert(sizeof(GridCell) % sizeof(float) == 0, "GridCell must be float-addressable");
+    static_assert(sizeof(Particle) % sizeof(float) == 0, "Particle must be float-addressable");
+
+#ifdef FLUID_G2P_X86
+    __attribute__((target("avx2")))
+    static void kernel_avx2(const Params& params, int begin, int end) {
+        const GridGeometry& geom = params.geom;
+        const float* grid = reinterpret_cast<const float*>(params.grid);
+        float* particles = reinterpret_cast<float*>(params.particles);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 one = _mm256_set1_ps(1);
+        const __m256 blend = _mm256_set1_ps(params.pic_flip_blend);
+        const __m256i stride_y = _mm256_set1_epi32(geom.grid_dimensions.x);
+        const __m256i stride_z = _mm256_set1_epi32(geom.grid_dimensions.x * geom.grid_dimensions.y);
+        const __m256i zero_i = _mm256_setzero_si256();
+
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const __m256i particle_index = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lanes), _mm256_set1_epi32(particle_floats));
+            __m256 pos[3], vel[3];
+            for (int k = 0; k < 3; ++k) {
+                pos[k] = _mm256_i32gather_ps(particles + pos_offset + k, particle_index, 4);
+                vel[k] = _mm256_i32gather_ps(particles + particle_vel_offset + k, particle_index, 4);
+            }
+
+            __m256 new_vel[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                // per-dimension base corner index (clamped for offset 0 and 1) and weight
+                __m256i lo[3], hi[3];
+                __m256 weight[3];
+                for (int k = 0; k < 3; ++k) {
+                    const int dimension_offset = k == axis ? 0 : 1;
+                    const float h = geom.cell_size[k];
+                    const __m256 t = _mm256_mul_ps(
+                        _mm256_div_ps(
+                            _mm256_sub_ps(_mm256_add_ps(pos[k], _mm256_set1_ps(-dimension_offset * (h / 2.f))), _mm256_set1_ps(geom.bounds_min[k])),
+                            _mm256_set1_ps(geom.bounds_size[k])),
+                        _mm256_set1_ps(geom.grid_cell_dimensions[k]));
+                    const __m256 base = _mm256_floor_ps(t);
+                    const __m256 world = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_set1_ps(geom.bounds_min[k]), _mm256_mul_ps(base, _mm256_set1_ps(h))),
+                        _mm256_set1_ps(dimension_offset * h * 0.5f));
+                    weight[k] = _mm256_div_ps(_mm256_sub_ps(pos[k], world), _mm256_set1_ps(h));
+
+                    const __m256i base_i = _mm256_cvttps_epi32(base);
+                    lo[k] = _mm256_max_epi32(zero_i, _mm256_min_epi32(base_i, _mm256_set1_epi32(geom.grid_cell_dimensions[k] - 1)));
+                    hi[k] = _mm256_max_epi32(zero_i, _mm256_min_epi32(_mm256_add_epi32(base_i, _mm256_set1_epi32(1)), _mm256_set1_epi32(geom.grid_dimensions[k] - 1)));
+                }
+
+                __m256 corner_vel[8], corner_old[8];
+                for (int c = 0; c < 8; ++c) {
+                    const __m256i x = (c & 1) ? hi[0] : lo[0];
+                    const __m256i y = (c & 2) ? hi[1] : lo[1];
+                    const __m256i z = (c & 4) ? hi[2] : lo[2];
+                    const __m256i cell = _mm256_add_epi32(x, _mm256_add_epi32(_mm256_mullo_epi32(y, stride_y), _mm256_mullo_epi32(z, stride_z)));
+                    const __m256i index = _mm256_mullo_epi32(cell, _mm256_set1_epi32(cell_floats));
+                    corner_vel[c] = _mm256_i32gather_ps(grid + vel_offset + axis, index, 4);
+                    corner_old[c] = _mm256_i32gather_ps(grid + old_vel_offset + axis, index, 4);
+                }
+
+                auto trilerp = [&](const __m256* v) __attribute__((target("avx2"))) {
+                    const __m256 wx = weight[0], wy = weight[1], wz = weight[2];
+                    const __m256 iwx = _mm256_sub_ps(one, wx), iwy = _mm256_sub_ps(one, wy), iwz = _mm256_sub_ps(one, wz);
+                    const __m256 x1 = _mm256_add_ps(_mm256_mul_ps(v[0], iwx), _mm256_mul_ps(v[1], wx));
+                    const __m256 x2 = _mm256_add_ps(_mm256_mul_ps(v[2], iwx), _mm256_mul_ps(v[3], wx));
+                    const __m256 x3 = _mm256_add_ps(_mm256_mul_ps(v[4], iwx), _mm256_mul_ps(v[5], wx));
+                    const __m256 x4 = _mm256_add_ps(_mm256_mul_ps(v[6], iwx), _mm256_mul_ps(v[7], wx));
+                    const __m256 y1 = _mm256_add_ps(_mm256_mul_ps(x1, iwy), _mm256_mul_ps(x2, wy));
+                    const __m256 y2 = _mm256_add_ps(_mm256_mul_ps(x3, iwy), _mm256_mul_ps(x4, wy));
+                    return _mm256_add_ps(_mm256_mul_ps(y1, iwz), _mm256_mul_ps(y2, wz));
+                };
+
+                const __m256 pic = trilerp(corner_vel);
+                const __m256 flip = _mm256_sub_ps(_mm256_add_ps(vel[axis], pic), trilerp(corner_old));
+                new_vel[axis] = _mm256_add_ps(_mm256_mul_ps(pic, _mm256_sub_ps(one, blend)), _mm256_mul_ps(flip, blend));
+            }
+
+            alignas(32) float out[3][8];
+            for (int k = 0; k < 3; ++k) {
+                _mm256_store_ps(out[k], new_vel[k]);
+            }
+            for (int j = 0; j < 8; ++j) {
+                params.particles[i + j].vel = glm::vec3(out[0][j], out[1][j], out[2][j]);
+            }
+        }
+        kernel_scalar(params, i, end);
+    }
+
+    __attribute__((target("sse4.1")))
+    static void kernel_sse41(const Params& params, int begin, int end) {
+        const GridGeometry& geom = params.geom;
+        const float* grid = reinterpret_cast<const float*>(params.grid);
+        const __m128 one = _mm_set1_ps(1);
+        const __m128 blend = _mm_set1_ps(params.pic_flip_blend);
+        const __m128i stride_y = _mm_set1_epi32(geom.grid_dimensions.x);
+        const __m128i stride_z = _mm_set1_epi32(geom.grid_dimensions.x * geom.grid_dimensions.y);
+        const __m128i zero_i = _mm_setzero_si128();
+
+        int i = begin;
+        for (; i + 4 <= end; i += 4) {
+            const Particle* p = params.particles + i;
+            __m128 pos[3], vel[3];
+            for (int k = 0; k < 3; ++k) {
+                pos[k] = _mm_setr_ps(p[0].pos[k], p[1].pos[k], p[2].pos[k], p[3].pos[k]);
+                vel[k] = _mm_setr_ps(p[0].vel[k], p[1].vel[k], p[2].vel[k], p[3].vel[k]);
+            }
+
+            __m128 new_vel[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                __m128i lo[3], hi[3];
+                __m128 weight[3];
+                for (int k = 0; k < 3; ++k) {
+                    const int dimension_offset = k == axis ? 0 : 1;
+                    const float h = geom.cell_size[k];
+                    const __m128 t = _mm_mul_ps(
+                        _mm_div_ps(
+                            _mm_sub_ps(_mm_add_ps(pos[k], _mm_set1_ps(-dimension_offset * (h / 2.f))), _mm_set1_ps(geom.bounds_min[k])),
+                            _mm_set1_ps(geom.bounds_size[k])),
+                        _mm_set1_ps(geom.grid_cell_dimensions[k]));
+                    const __m128 base = _mm_floor_ps(t);
+                    const __m128 world = _mm_add_ps(
+                        _mm_add_ps(_mm_set1_ps(geom.bounds_min[k]), _mm_mul_ps(base, _mm_set1_ps(h))),
+                        _mm_set1_ps(dimension_offset * h * 0.5f));
+                    weight[k] = _mm_div_ps(_mm_sub_ps(pos[k], world), _mm_set1_ps(h));
+
+                    const __m128i base_i = _mm_cvttps_epi32(base);
+                    lo[k] = _mm_max_epi32(zero_i, _mm_min_epi32(base_i, _mm_set1_epi32(geom.grid_cell_dimensions[k] - 1)));
+                    hi[k] = _mm_max_epi32(zero_i, _mm_min_epi32(_mm_add_epi32(base_i, _mm_set1_epi32(1)), _mm_set1_epi32(geom.grid_dimensions[k] - 1)));
+                }
+
+                __m128 corner_vel[8], corner_old[8];
+                for (int c = 0; c < 8; ++c) {
+                    const __m128i x = (c & 1) ? hi[0] : lo[0];
+                    const __m128i y = (c & 2) ? hi[1] : lo[1];
+                    const __m128i z = (c & 4) ? hi[2] : lo[2];
+                    const __m128i cell = _mm_add_epi32(x, _mm_add_epi32(_mm_mullo_epi32(y, stride_y), _mm_mullo_epi32(z, stride_z)));
+                    alignas(16) int index[4];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(index), cell);
+                    const float* c0 = grid + index[0] * cell_floats + axis;
+                    const float* c1 = grid + index[1] * cell_floats + axis;
+                    const float* c2 = grid + index[2] * cell_floats + axis;
+                    const float* c3 = grid + index[3] * cell_floats + axis;
+                    corner_vel[c] = _mm_setr_ps(c0[vel_offset], c1[vel_offset], c2[vel_offset], c3[vel_offset]);
+                    corner_old[c] = _mm_setr_ps(c0[old_vel_offset], c1[old_vel_offset], c2[old_vel_offset], c3[old_vel_offset]);
+                }
+
+                auto trilerp = [&](const __m128* v) __attribute__((target("sse4.1"))) {
+                    const __m128 wx = weight[0], wy = weight[1], wz = weight[2];
+                    const __m128 iwx = _mm_sub_ps(one, wx), iwy = _mm_sub_ps(one, wy), iwz = _mm_sub_ps(one, wz);
+                    const __m128 x1 = _mm_add_ps(_mm_mul_ps(v[0], iwx), _mm_mul_ps(v[1], wx));
+                    const __m128 x2 = _mm_add_ps(_mm_mul_ps(v[2], iwx), _mm_mul_ps(v[3], wx));
+                    const __m128 x3 = _mm_add_ps(_mm_mul_ps(v[4], iwx), _mm_mul_ps(v[5], wx));
+                    const __m128 x4 = _mm_add_ps(_mm_mul_ps(v[6], iwx), _mm_mul_ps(v[7], wx));
+                    const __m128 y1 = _mm_add_ps(_mm_mul_ps(x1, iwy), _mm_mul_ps(x2, wy));
+                    const __m128 y2 = _mm_add_ps(_mm_mul_ps(x3, iwy), _mm_mul_ps(x4, wy));
+                    return _mm_add_ps(_mm_mul_ps(y1, iwz), _mm_mul_ps(y2, wz));
+                };
+
+                const __m128 pic = trilerp(corner_vel);
+                const __m128 flip = _mm_sub_ps(_mm_add_ps(vel[axis], pic), trilerp(corner_old));
+                new_vel[axis] = _mm_add_ps(_mm_mul_ps(pic, _mm_sub_ps(one, blend)), _mm_mul_ps(flip, blend));
+            }
+
+            alignas(16) float out[3][4];
+            for (int k = 0; k < 3; ++k) {
+                _mm_store_ps(out[k], new_vel[k]);
+            }
+            for (int j = 0; j < 4; ++j) {
+                params.particles[i + j].vel = glm::vec3(out[0][j], out[1][j], out[2][j]);
+            }
+        }
+        kernel_scalar(params, i, end);
+    }
+#endif
+};
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtx/component_wise.hpp>
+
+namespace cpu {
+/**
+ * Grid dimensions and coordinate helpers, mirroring common.glsl.
+ */
+struct GridGeometry {
+    const glm::ivec3 grid_dimensions;
+    const glm::ivec3 grid_cell_dimensions;
+    const glm::vec3 bounds_min;
+    const glm::vec3 bounds_max;
+    const glm::vec3 bounds_size;
+    const glm::vec3 cell_size;
+
+    GridGeometry(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+        : grid_dimensions(grid_dimensions),
+          grid_cell_dimensions(grid_dimensions - glm::ivec3(1)),
+          bounds_min(bounds_min),
+          bounds_max(bounds_max),
+          bounds_size(bounds_max - bounds_min),
+          cell_size(bounds_size / glm::vec3(grid_cell_dimensions)) {}
+
+    int num_cells() const {
+        return glm::compMul(grid_dimensions);
+    }
+
+    glm::ivec3 get_grid_coord(const glm::vec3& pos, const glm::ivec3& half_offset) const {
+        return glm::floor((pos + glm::vec3(half_offset) * (cell_size / 2.f) - bounds_min) / bounds_size * glm::vec3(grid_cell_dimensions));
+    }
+
+    glm::vec3 get_world_coord(const glm::ivec3& grid_coord, const glm::ivec3& half_offset) const {
+        return bounds_min + glm::vec3(grid_coord) * cell_size + glm::vec3(half_offset) * cell_size * 0.5f;
+    }
+
+    int get_grid_index(const glm::ivec3& grid_coord) const {
+        const glm::ivec3 c = glm::clamp(grid_coord, glm::ivec3(0), grid_dimensions - glm::ivec3(1));
+        return c.z * grid_dimensions.y * grid_dimensions.x + c.y * grid_dimensions.x + c.x;
+    }
+
+    glm::ivec3 get_grid_coord_from_index(int index) const {
+        const int x = index % grid_dimensions.x;
+        const int y = index / grid_dimensions.x % grid_dimensions.y;
+        const int z = index / (grid_dimensions.x * grid_dimensions.y);
+        return {x, y, z};
+    }
+
+    glm::ivec3 offset_clamped(const glm::ivec3& base_coord, const glm::ivec3& dimension_offset) const {
+        // apply an offset (in one basis direction) and clamp to MAC grid
+        glm::ivec3 max_size = grid_cell_dimensions;
+        if (dimension_offset.x > 0)
+            max_size.x = grid_dimensions.x;
+        if (dimension_offset.y > 0)
+            max_size.y = grid_dimensions.y;
+        if (dimension_offset.z > 0)
+            max_size.z = grid_dimensions.z;
+        return glm::clamp(base_coord + dimension_offset, glm::ivec3(0), max_size - glm::ivec3(1));
+    }
+};
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include "../GridCell.hpp"
+#include "grid_geometry.hpp"
+
+namespace cpu {
+/**
+ * Upper bound on the spectral radius of the Jacobi iteration matrix
+ * I - D^-1 A of the pressure system, for Chebyshev acceleration.
+ *
+ * A is read from a_diag/a_x/a_y/a_z as written by build_a. I - D^-1 A is
+ * similar to the symmetric S = -D^-1/2 (A - D) D^-1/2, and since the grid is
+ * bipartite the spectrum of S is symmetric about 0, so the spectral radius is
+ * its largest eigenvalue. That is estimated with a few Lanczos steps; the
+ * largest Ritz value plus its residual bound can only overestimate it, which
+ * keeps Chebyshev iteration stable (an underestimate would make it diverge).
+ */
+inline float estimate_jacobi_radius(const GridGeometry& geom, const GridCell* grid, int steps = 32) {
+    const glm::ivec3& dim = geom.grid_dimensions;
+    const int n = geom.num_cells();
+    const int strides[3] = {1, dim.x, dim.x * dim.y};
+
+    std::vector<float> inv_sqrt_diag(n, 0.f);
+    for (int i = 0; i < n; ++i) {
+        if (grid[i].type == GRID_FLUID and grid[i].a_diag != 0)
+            inv_sqrt_diag[i] = 1 / std::sqrt(grid[i].a_diag);
+    }
+
+    // w = S v, same neighbor terms as jacobi_iterate.cs.glsl
+    auto apply_s = [&](const std::vector<double>& v, std::vector<double>& w) {
+        std::fill(w.begin(), w.end(), 0.0);
+        for (int i = 0; i < n; ++i) {
+            if (inv_sqrt_diag[i] == 0)
+                continue;
+            const glm::ivec3 c = geom.get_grid_coord_from_index(i);
+            const float coefficients[3] = {grid[i].a_x, grid[i].a_y, grid[i].a_z};
+            for (int axis = 0; axis < 3; ++axis) {
+                const int j = i + strides[axis];
+                if (c[axis] >= dim[axis] - 2 or inv_sqrt_diag[j] == 0)
+                    continue;
+                const double s = -coefficients[axis] * inv_sqrt_diag[i] * inv_sqrt_diag[j];
+                w[i] += s * v[j];
+                w[j] += s * v[i];
+            }
+        }
+    };
+
+    std::vector<double> v(n, 0.0), v_previous(n, 0.0), w(n);
+    double norm = 0;
+    for (int i = 0; i < n; ++i) {
+        // any start vector works; vary it so it's unlikely to miss the top eigenvector
+        v[i] = inv_sqrt_diag[i] != 0 ? 1.0 + 0.5 * std::sin(i * 0.7) : 0.0;
+        norm += v[i] * v[i];
+    }
+    if (norm == 0)
+        return 0;
+    for (double& x : v) {
+        x /= std::sqrt(norm);
+    }
+
+    std::vector<double> alpha, beta;
+    for (int k = 0; k < steps; ++k) {
+        apply_s(v, w);
+        double a = 0;
+        for (int i = 0; i < n; ++i) {
+            a += w[i] * v[i];
+        }
+        double b = 0;
+        for (int i = 0; i < n; ++i) {
+            w[i] -= a * v[i] + (k > 0 ? beta.back() * v_previous[i] : 0.0);
+            b += w[i] * w[i];
+        }
+        b = std::sqrt(b);
+        alpha.push_back(a);
+        beta.push_back(b);
+        if (b < 1e-10)
+            break;
+        v_previous.swap(v);
+        for (int i = 0; i < n; ++i) {
+            v[i] = w[i] / b;
+        }
+    }
+
+    const int m = alpha.size();
+    Eigen::MatrixXd t = Eigen::MatrixXd::Zero(m, m);
+    for (int k = 0; k < m; ++k) {
+        t(k, k) = alpha[k];
+        if (k + 1 < m) {
+            t(k, k + 1) = beta[k];
+            t(k + 1, k) = beta[k];
+        }
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(t);
+    const double ritz = solver.eigenvalues()(m - 1);
+    const double residual_bound = std::abs(beta.back() * solver.eigenvectors()(m - 1, m - 1));
+    return std::min(1.0, ritz + residual_bound);
+}
+}
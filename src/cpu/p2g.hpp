@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include "../GridCell.hpp"
+#include "../Particle.hpp"
+#include "grid_geometry.hpp"
+#include "thread_pool.hpp"
+
+namespace cpu {
+/**
+ * Parallel particle-to-grid transfer without atomics or hashing.
+ *
+ * Particles are first binned by grid cell with a stable two-pass counting sort
+ * (by row of cells, then by cell within each row). Each thread then takes a
+ * contiguous run of the sorted particles; since those particles occupy a
+ * contiguous range of cells, the thread scatters into a dense private buffer
+ * that only spans that range plus the one-cell interpolation stencil. Finally
+ * the (mostly disjoint) private buffers are merged in parallel over grid
+ * cells, so every grid value is written by exactly one thread.
+ *
+ * Weights and clamping mirror p2g_accumulate.cs.glsl and p2g_apply.cs.glsl.
+ * Results are deterministic for a given thread count.
+ */
+class ParticleToGrid {
+public:
+    struct Transfer {
+        float u = 0, v = 0, w = 0;
+        float weight_u = 0, weight_v = 0, weight_w = 0;
+    };
+
+    std::vector<int> particle_cell; // grid index of the cell containing each particle
+    std::vector<int> order; // particle indices sorted by cell
+    std::vector<int> cell_count; // number of particles in each cell
+
+    /**
+     * Overwrites type and vel of every grid cell with the transferred particle velocities.
+     */
+    void run(ThreadPool& pool, const GridGeometry& geom, const Particle* particles, int num_particles, GridCell* grid) {
+        bin(pool, geom, particles, num_particles);
+        accumulate(pool, geom, particles, num_particles);
+        merge(pool, geom, grid);
+    }
+
+private:
+    std::vector<int> row_order; // particle indices sorted by row of cells only
+    std::vector<int> row_histogram; // per-thread particle count for each row, then scatter offsets
+    std::vector<int> row_start;
+    std::vector<std::vector<Transfer>> thread_transfer;
+    std::vector<int> window_begin; // range of grid indices covered by each thread_transfer
+    std::vector<int> window_end;
+
+    void bin(ThreadPool& pool, const GridGeometry& geom, const Particle* particles, int num_particles) {
+        const glm::ivec3& dim = geom.grid_dimensions;
+        const int num_rows = dim.y * dim.z;
+        const int num_threads = pool.size();
+
+        particle_cell.resize(num_particles);
+        row_order.resize(num_particles);
+        order.resize(num_particles);
+        cell_count.resize(geom.num_cells());
+        row_start.resize(num_rows + 1);
+        row_histogram.assign(num_threads * num_rows, 0);
+
+        // count particles per row, separately for each thread's chunk
+        pool.parallel_for_range(0, num_particles, [&](int lo, int hi, int thread) {
+            int* histogram = &row_histogram[thread * num_rows];
+            for (int i = lo; i < hi; ++i) {
+                const int cell = geom.get_grid_index(geom.get_grid_coord(particles[i].pos, {0, 0, 0}));
+                particle_cell[i] = cell;
+                ++histogram[cell / dim.x];
+            }
+        });
+
+        // row totals and their exclusive prefix sum
+        pool.parallel_for(0, num_rows, [&](int row) {
+            int total = 0;
+            for (int t = 0; t < num_threads; ++t) {
+                total += row_histogram[t * num_rows + row];
+            }
+            row_start[row + 1] = total;
+        });
+        row_start[0] = 0;
+        for (int row = 0; row < num_rows; ++row) {
+            row_start[row + 1] += row_start[row];
+        }
+
+        // turn counts into per-thread scatter offsets (lower threads first, so the sort is stable)
+        pool.parallel_for(0, num_rows, [&](int row) {
+            int offset = row_start[row];
+            for (int t = 0; t < num_threads; ++t) {
+                const int count = row_histogram[t * num_rows + row];
+                row_histogram[t * num_rows + row] = offset;
+                offset += count;
+            }
+        });
+
+        // scatter by row; chunks match the counting pass
+        pool.parallel_for_range(0, num_particles, [&](int lo, int hi, int thread) {
+            int* offsets = &row_histogram[thread * num_rows];
+            for (int i = lo; i < hi; ++i) {
+                row_order[offsets[particle_cell[i] / dim.x]++] = i;
+            }
+        });
+
+        // sort each row by cell
+        pool.parallel_for_range(0, num_rows, [&](int lo, int hi, int) {
+            std::vector<int> offsets(dim.x);
+            for (int row = lo; row < hi; ++row) {
+                int* counts = &cell_count[row * dim.x];
+                std::fill(counts, counts + dim.x, 0);
+                for (int j = row_start[row]; j < row_start[row + 1]; ++j) {
+                    ++counts[particle_cell[row_order[j]] % dim.x];
+                }
+                int offset = row_start[row];
+                for (int x = 0; x < dim.x; ++x) {
+                    offsets[x] = offset;
+                    offset += counts[x];
+                }
+                for (int j = row_start[row]; j < row_start[row + 1]; ++j) {
+                    const int i = row_order[j];
+                    order[offsets[particle_cell[i] % dim.x]++] = i;
+                }
+            }
+        });
+    }
+
+    void accumulate(ThreadPool& pool, const GridGeometry& geom, const Particle* particles, int num_particles) {
+        const glm::ivec3& dim = geom.grid_dimensions;
+        // largest grid index distance between a particle's cell and a node in its stencil
+        const int reach = dim.x * dim.y + dim.x + 1;
+
+        thread_transfer.resize(pool.size());
+        window_begin.assign(pool.size(), 0);
+        window_end.assign(pool.size(), 0);
+
+        pool.parallel_for_range(0, num_particles, [&](int lo, int hi, int thread) {
+            const int begin = std::max(0, particle_cell[order[lo]] - reach);
+            const int end = std::min(geom.num_cells(), particle_cell[order[hi - 1]] + reach + 1);
+            window_begin[thread] = begin;
+            window_end[thread] = end;
+            std::vector<Transfer>& transfer = thread_transfer[thread];
+            transfer.assign(end - begin, Transfer());
+
+            auto scatter_part = [&](const glm::ivec3& coord, const glm::vec3& weights, int axis, float vel) {
+                Transfer& t = transfer[geom.get_grid_index(coord) - begin];
+                const float weight = glm::compMul(weights);
+                if (axis == 0) {
+                    t.u += vel * weight;
+                    t.weight_u += weight;
+                } else if (axis == 1) {
+                    t.v += vel * weight;
+                    t.weight_v += weight;
+                } else {
+                    t.w += vel * weight;
+                    t.weight_w += weight;
+                }
+            };
+
+            for (int j = lo; j < hi; ++j) {
+                const Particle& p = particles[order[j]];
+                for (int axis = 0; axis < 3; ++axis) {
+                    glm::ivec3 component(0);
+                    component[axis] = 1;
+                    const float vel = p.vel[axis];
+                    if (vel == 0)
+                        continue; // contributes neither velocity nor weight
+                    const glm::ivec3 base_coord = geom.get_grid_coord(p.pos, -component);
+                    const glm::vec3 wgt = (p.pos - geom.get_world_coord(base_coord, component)) / geom.cell_size;
+                    scatter_part(geom.offset_clamped(base_coord, {0, 0, 0}), {  wgt.x,   wgt.y,   wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {1, 0, 0}), {1-wgt.x,   wgt.y,   wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {0, 1, 0}), {  wgt.x, 1-wgt.y,   wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {0, 0, 1}), {  wgt.x,   wgt.y, 1-wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {1, 1, 0}), {1-wgt.x, 1-wgt.y,   wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {0, 1, 1}), {  wgt.x, 1-wgt.y, 1-wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {1, 0, 1}), {1-wgt.x,   wgt.y, 1-wgt.z}, axis, vel);
+                    scatter_part(geom.offset_clamped(base_coord, {1, 1, 1}), {1-wgt.x, 1-wgt.y, 1-wgt.z}, axis, vel);
+                }
+            }
+        });
+    }
+
+    void merge(ThreadPool& pool, const GridGeometry& geom, GridCell* grid) {
+        const int num_windows = window_begin.size();
+        pool.parallel_for_range(0, geom.num_cells(), [&](int lo, int hi, int) {
+            // windows are ordered and only overlap their neighbors, so few intersect [lo, hi)
+            std::vector<int> windows;
+            for (int t = 0; t < num_windows; ++t) {
+                if (window_begin[t] < hi and window_end[t] > lo)
+                    windows.push_back(t);
+            }
+
+            for (int i = lo; i < hi; ++i) {
+                Transfer sum;
+                for (int t : windows) {
+                    if (i < window_begin[t] or i >= window_end[t])
+                        continue;
+                    const Transfer& part = thread_transfer[t][i - window_begin[t]];
+                    sum.u += part.u;
+                    sum.v += part.v;
+                    sum.w += part.w;
+                    sum.weight_u += part.weight_u;
+                    sum.weight_v += part.weight_v;
+                    sum.weight_w += part.weight_w;
+                }
+
+                GridCell& cell = grid[i];
+                cell.type = cell_count[i] > 0 ? GRID_FLUID : GRID_AIR;
+                cell.vel.x = sum.weight_u != 0 ? sum.u / sum.weight_u : 0;
+                cell.vel.y = sum.weight_v != 0 ? sum.v / sum.weight_v : 0;
+                cell.vel.z = sum.weight_w != 0 ? sum.w / sum.weight_w : 0;
+            }
+        });
+    }
+};
+}
@@ -0,0 +1,292 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "../GridCell.hpp"
+#include "grid_geometry.hpp"
+#include "thread_pool.hpp"
+
+namespace cpu {
+/**
+ * Matrix-free preconditioned conjugate gradient solve of the pressure equation.
+ *
+ * The 7-point Laplacian is read directly from GridCell::a_diag/a_x/a_y/a_z as
+ * written by build_a, so no sparse matrix is assembled. The preconditioner is
+ * modified incomplete Cholesky, MIC(0), as described in Bridson's "Fluid
+ * Simulation for Computer Graphics". Its triangular solves are parallelized
+ * over wavefronts: grid rows (y, z) with equal y + z only depend on rows of
+ * the previous wavefront, so each wavefront is split among the threads.
+ *
+ * The solve is warm started from pressure_guess and writes the result to both
+ * pressure and pressure_guess, like the Jacobi solver.
+ */
+class PressurePCG {
+public:
+    float tolerance = 1e-5; // stop once max |residual| <= tolerance * max |rhs|
+    int max_iterations = 200;
+    float mic_tau = 0.97; // 0 gives plain incomplete Cholesky
+    float mic_sigma = 0.25; // pivots smaller than this fraction of a_diag fall back to a_diag
+
+    int iterations = 0; // iterations taken by the last solve
+    float residual = 0; // max |residual| after the last solve
+
+    void solve(ThreadPool& pool, const GridGeometry& geom, GridCell* grid) {
+        dim = geom.grid_dimensions;
+        stride_y = dim.x;
+        stride_z = dim.x * dim.y;
+        const int n = geom.num_cells();
+        active.resize(n);
+        pressure.resize(n);
+        precon.resize(n);
+        r.resize(n);
+        q.resize(n);
+        z.resize(n);
+        s.resize(n);
+        thread_sum.resize(pool.size());
+        thread_max.resize(pool.size());
+        iterations = 0;
+
+        // find unknowns, warm start, r = b - Ap
+        reset_reductions();
+        for_each_cell(pool, [&](const glm::ivec3&, int i, int thread) {
+            const GridCell& cell = grid[i];
+            active[i] = cell.type == GRID_FLUID and cell.a_diag != 0;
+            pressure[i] = active[i] ? cell.pressure_guess : 0;
+            precon[i] = 0;
+            q[i] = 0;
+            z[i] = 0;
+            s[i] = 0;
+            if (active[i])
+                thread_max[thread] = std::max(thread_max[thread], std::abs(cell.rhs));
+        });
+        const float max_rhs = reduce_max();
+        if (max_rhs == 0) {
+            std::fill(pressure.begin(), pressure.end(), 0.f);
+            residual = 0;
+            write_back(pool, grid);
+            return;
+        }
+
+        reset_reductions();
+        for_each_cell(pool, [&](const glm::ivec3& c, int i, int thread) {
+            r[i] = active[i] ? grid[i].rhs - apply_a(grid, pressure, c, i) : 0;
+            thread_max[thread] = std::max(thread_max[thread], std::abs(r[i]));
+        });
+        residual = reduce_max();
+        if (residual <= tolerance * max_rhs) {
+            write_back(pool, grid);
+            return;
+        }
+
+        build_preconditioner(pool, grid);
+        double rho = apply_preconditioner(pool, grid);
+        for_each_cell(pool, [&](const glm::ivec3&, int i, int) {
+            s[i] = z[i];
+        });
+
+        while (iterations < max_iterations) {
+            ++iterations;
+
+            // z = As
+            reset_reductions();
+            for_each_cell(pool, [&](const glm::ivec3& c, int i, int thread) {
+                z[i] = active[i] ? apply_a(grid, s, c, i) : 0;
+                thread_sum[thread] += static_cast<double>(s[i]) * z[i];
+            });
+            const double s_dot_z = reduce_sum();
+            if (s_dot_z == 0)
+                break;
+            const float alpha = rho / s_dot_z;
+
+            reset_reductions();
+            for_each_cell(pool, [&](const glm::ivec3&, int i, int thread) {
+                pressure[i] += alpha * s[i];
+                r[i] -= alpha * z[i];
+                thread_max[thread] = std::max(thread_max[thread], std::abs(r[i]));
+            });
+            residual = reduce_max();
+            if (residual <= tolerance * max_rhs)
+                break;
+
+            const double rho_new = apply_preconditioner(pool, grid);
+            const float beta = rho_new / rho;
+            for_each_cell(pool, [&](const glm::ivec3&, int i, int) {
+                s[i] = z[i] + beta * s[i];
+            });
+            rho = rho_new;
+        }
+
+        write_back(pool, grid);
+    }
+
+private:
+    glm::ivec3 dim{0};
+    int stride_y = 0;
+    int stride_z = 0;
+
+    std::vector<char> active; // cell is an unknown of the system
+    std::vector<float> pressure;
+    std::vector<float> precon;
+    std::vector<float> r; // residual
+    std::vector<float> q; // intermediate result of the preconditioner's forward solve
+    std::vector<float> z; // preconditioned residual, or As during the update
+    std::vector<float> s; // search direction
+    std::vector<double> thread_sum;
+    std::vector<float> thread_max;
+
+    /**
+     * Call fn(grid_coord, index, thread_index) for every grid cell, in parallel.
+     */
+    template <typename F>
+    void for_each_cell(ThreadPool& pool, F fn) const {
+        pool.parallel_for_range(0, dim.y * dim.z, [&](int lo, int hi, int thread) {
+            for (int row = lo; row < hi; ++row) {
+                const int y = row % dim.y;
+                const int z = row / dim.y;
+                for (int x = 0; x < dim.x; ++x) {
+                    fn(glm::ivec3(x, y, z), row * dim.x + x, thread);
+                }
+            }
+        });
+    }
+
+    /**
+     * Call fn(y, z, thread_index) for every row of grid cells, one wavefront
+     * (y + z = const) at a time.
+     */
+    template <typename F>
+    void for_each_wavefront(ThreadPool& pool, bool reverse, F fn) const {
+        const int num_waves = dim.y + dim.z - 1;
+        const int num_threads = pool.size();
+        SpinBarrier barrier(num_threads);
+        pool.run([&](int thread) {
+            for (int w = 0; w < num_waves; ++w) {
+                const int wave = reverse ? num_waves - 1 - w : w;
+                const int y_begin = std::max(0, wave - (dim.z - 1));
+                const int y_end = std::min(dim.y, wave + 1);
+                const int count = y_end - y_begin;
+                const int lo = y_begin + count * thread / num_threads;
+                const int hi = y_begin + count * (thread + 1) / num_threads;
+                for (int y = lo; y < hi; ++y) {
+                    fn(y, wave - y, thread);
+                }
+                barrier.wait();
+            }
+        });
+    }
+
+    void reset_reductions() {
+        std::fill(thread_sum.begin(), thread_sum.end(), 0.0);
+        std::fill(thread_max.begin(), thread_max.end(), 0.f);
+    }
+
+    double reduce_sum() const {
+        double sum = 0;
+        for (double part : thread_sum) {
+            sum += part;
+        }
+        return sum;
+    }
+
+    float reduce_max() const {
+        return *std::max_element(thread_max.begin(), thread_max.end());
+    }
+
+    float apply_a(const GridCell* grid, const std::vector<float>& v, const glm::ivec3& c, int i) const {
+        // same neighbor terms as jacobi_iterate.cs.glsl
+        const GridCell& cell = grid[i];
+        float result = cell.a_diag * v[i];
+        if (c.x > 0)
+            result += grid[i - 1].a_x * v[i - 1];
+        if (c.y > 0)
+            result += grid[i - stride_y].a_y * v[i - stride_y];
+        if (c.z > 0)
+            result += grid[i - stride_z].a_z * v[i - stride_z];
+        if (c.x < dim.x - 2)
+            result += cell.a_x * v[i + 1];
+        if (c.y < dim.y - 2)
+            result += cell.a_y * v[i + stride_y];
+        if (c.z < dim.z - 2)
+            result += cell.a_z * v[i + stride_z];
+        return result;
+    }
+
+    void build_preconditioner(ThreadPool& pool, const GridCell* grid) {
+        for_each_wavefront(pool, false, [&](int y, int z, int) {
+            for (int x = 0; x < dim.x; ++x) {
+                const int i = z * stride_z + y * stride_y + x;
+                if (!active[i])
+                    continue;
+                const GridCell& cell = grid[i];
+                float e = cell.a_diag;
+                auto subtract = [&](int j, float a, float a_other) {
+                    const float p = precon[j];
+                    e -= a * p * a * p + mic_tau * a * a_other * p * p;
+                };
+                if (x > 0)
+                    subtract(i - 1, grid[i - 1].a_x, grid[i - 1].a_y + grid[i - 1].a_z);
+                if (y > 0)
+                    subtract(i - stride_y, grid[i - stride_y].a_y, grid[i - stride_y].a_x + grid[i - stride_y].a_z);
+                if (z > 0)
+                    subtract(i - stride_z, grid[i - stride_z].a_z, grid[i - stride_z].a_x + grid[i - stride_z].a_y);
+                if (e < mic_sigma * cell.a_diag)
+                    e = cell.a_diag;
+                precon[i] = 1 / std::sqrt(e);
+            }
+        });
+    }
+
+    /**
+     * z = M^-1 r; returns dot(z, r).
+     */
+    double apply_preconditioner(ThreadPool& pool, const GridCell* grid) {
+        // solve Lq = r
+        for_each_wavefront(pool, false, [&](int y, int z, int) {
+            for (int x = 0; x < dim.x; ++x) {
+                const int i = z * stride_z + y * stride_y + x;
+                if (!active[i])
+                    continue;
+                float t = r[i];
+                if (x > 0)
+                    t -= grid[i - 1].a_x * precon[i - 1] * q[i - 1];
+                if (y > 0)
+                    t -= grid[i - stride_y].a_y * precon[i - stride_y] * q[i - stride_y];
+                if (z > 0)
+                    t -= grid[i - stride_z].a_z * precon[i - stride_z] * q[i - stride_z];
+                q[i] = t * precon[i];
+            }
+        });
+
+        // solve L^T z = q
+        reset_reductions();
+        for_each_wavefront(pool, true, [&](int y, int zz, int thread) {
+            for (int x = dim.x - 1; x >= 0; --x) {
+                const int i = zz * stride_z + y * stride_y + x;
+                if (!active[i]) {
+                    z[i] = 0;
+                    continue;
+                }
+                const GridCell& cell = grid[i];
+                float t = q[i];
+                if (x < dim.x - 2)
+                    t -= cell.a_x * precon[i] * z[i + 1];
+                if (y < dim.y - 2)
+                    t -= cell.a_y * precon[i] * z[i + stride_y];
+                if (zz < dim.z - 2)
+                    t -= cell.a_z * precon[i] * z[i + stride_z];
+                z[i] = t * precon[i];
+                thread_sum[thread] += static_cast<double>(z[i]) * r[i];
+            }
+        });
+        return reduce_sum();
+    }
+
+    void write_back(ThreadPool& pool, GridCell* grid) const {
+        for_each_cell(pool, [&](const glm::ivec3&, int i, int) {
+            grid[i].pressure = pressure[i];
+            grid[i].pressure_guess = pressure[i];
+        });
+    }
+};
+}
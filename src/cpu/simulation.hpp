@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include "../GridCell.hpp"
+#include "../Particle.hpp"
+#include "g2p.hpp"
+#include "grid_geometry.hpp"
+#include "p2g.hpp"
+#include "pcg.hpp"
+#include "thread_pool.hpp"
+
+namespace cpu {
+/**
+ * CPU implementation of the simulation pipeline in Fluid::step().
+ *
+ * Each stage mirrors the compute shader of the same name and operates on host
+ * copies of the particle and grid buffers (same layout as the SSBOs, so they
+ * can be uploaded for rendering as-is). Stages are parallelized over cells or
+ * particles with a thread pool.
+ */
+struct Simulation : GridGeometry {
+    enum class PressureSolver {
+        JACOBI, // fixed iteration count, mirrors jacobi_iterate.cs.glsl
+        PCG, // MIC(0)-preconditioned conjugate gradient (PressurePCG)
+    };
+
+    const float density = 1; // kg/m^3
+
+    glm::vec3 gravity{0, -9.8, 0};
+    glm::vec3 world_mouse_pos{0, -0.9, 0};
+    glm::vec3 world_mouse_vel{0, 0, 0};
+    glm::vec3 eye{0, 0, 0};
+    float pic_flip_blend = 0.9;
+    PressureSolver pressure_solver = PressureSolver::PCG;
+    int jacobi_iterations = 40;
+
+    std::vector<Particle> particles;
+    std::vector<GridCell> grid;
+
+    ThreadPool& pool;
+    ParticleToGrid p2g;
+    GridToParticle g2p;
+    PressurePCG pcg; // solver settings and statistics for PressureSolver::PCG
+
+    Simulation(const glm::ivec3& grid_dimensions, const glm::vec3& bounds_min, const glm::vec3& bounds_max, ThreadPool& pool)
+        : GridGeometry(grid_dimensions, bounds_min, bounds_max), pool(pool) {}
+
+    void reset(const std::vector<Particle>& initial_particles, const std::vector<GridCell>& initial_grid) {
+        particles = initial_particles;
+        grid = initial_grid;
+    }
+
+    /**
+     * Call fn(grid_coord, index) for every grid cell, in parallel.
+     */
+    template <typename F>
+    void for_each_cell(F fn) {
+        pool.parallel_for_range(0, num_cells(), [&](int lo, int hi, int) {
+            for (int i = lo; i < hi; ++i) {
+                fn(get_grid_coord_from_index(i), i);
+            }
+        });
+    }
+
+    void reset_grid() {
+        for_each_cell([&](const glm::ivec3&, int i) {
+            grid[i].type = GRID_AIR;
+            grid[i].vel = glm::vec3(0);
+        });
+    }
+
+    void particle_to_grid() {
+        // also resets grid type and velocity
+        p2g.run(pool, *this, particles.data(), particles.size(), grid.data());
+    }
+
+    void apply_body_forces(float dt) {
+        // also enforces boundary condition
+        const glm::ivec3& d = grid_dimensions;
+        const glm::vec3 body_force = gravity;
+        for_each_cell([&](const glm::ivec3& c, int i) {
+            GridCell& cell = grid[i];
+            cell.old_vel = cell.vel;
+
+            if (c.y < d.y - 1 and c.z < d.z - 1)
+                cell.vel.x += body_force.x * dt;
+            if (c.x < d.x - 1 and c.z < d.z - 1)
+                cell.vel.y += body_force.y * dt;
+            if (c.x < d.x - 1 and c.y < d.y - 1)
+                cell.vel.z += body_force.z * dt;
+
+            if (c.x == 0 or c.x == d.x - 1)
+                cell.vel.x = 0;
+            if (c.y == 0 or c.y == d.y - 1)
+                cell.vel.y = 0;
+            if (c.z == 0 or c.z == d.z - 1)
+                cell.vel.z = 0;
+        });
+    }
+
+    void compute_divergence(const glm::ivec3& c, int i) {
+        const glm::ivec3& d = grid_dimensions;
+        GridCell& cell = grid[i];
+        cell.rhs = 0;
+
+        if (cell.type != GRID_FLUID)
+            return;
+
+        if (c.x < d.x - 1)
+            cell.rhs -= (grid[get_grid_index(c + glm::ivec3(1, 0, 0))].vel.x - cell.vel.x) / cell_size.x;
+        if (c.y < d.y - 1)
+            cell.rhs -= (grid[get_grid_index(c + glm::ivec3(0, 1, 0))].vel.y - cell.vel.y) / cell_size.y;
+        if (c.z < d.z - 1)
+            cell.rhs -= (grid[get_grid_index(c + glm::ivec3(0, 0, 1))].vel.z - cell.vel.z) / cell_size.z;
+
+        // account for solid boundaries
+        if (c.x == 0)
+            cell.rhs -= cell.vel.x / cell_size.x;
+        if (c.y == 0)
+            cell.rhs -= cell.vel.y / cell_size.y;
+        if (c.z == 0)
+            cell.rhs -= cell.vel.z / cell_size.z;
+        if (c.x == d.x - 2)
+            cell.rhs += grid[get_grid_index(c + glm::ivec3(1, 0, 0))].vel.x / cell_size.x;
+        if (c.y == d.y - 2)
+            cell.rhs += grid[get_grid_index(c + glm::ivec3(0, 1, 0))].vel.y / cell_size.y;
+        if (c.z == d.z - 2)
+            cell.rhs += grid[get_grid_index(c + glm::ivec3(0, 0, 1))].vel.z / cell_size.z;
+    }
+
+    void build_a(const glm::ivec3& c, int i, float dt) {
+        const glm::ivec3& d = grid_dimensions;
+        GridCell& cell = grid[i];
+        cell.pressure = 0;
+        // warm start - don't clear guess
+
+        cell.a_diag = 0;
+        cell.a_x = 0;
+        cell.a_y = 0;
+        cell.a_z = 0;
+
+        if (cell.type != GRID_FLUID)
+            return;
+
+        // cells may be longer along some axes, so each axis has its own coefficient
+        const glm::vec3 scale = dt / (density * cell_size * cell_size);
+        auto lower = [&](const glm::ivec3& offset) {
+            if (grid[get_grid_index(c + offset)].type == GRID_FLUID)
+                cell.a_diag += glm::dot(scale, glm::abs(glm::vec3(offset)));
+        };
+        auto upper = [&](const glm::ivec3& offset, float& a) {
+            const float axis_scale = glm::dot(scale, glm::vec3(offset));
+            const int type = grid[get_grid_index(c + offset)].type;
+            if (type == GRID_FLUID) {
+                cell.a_diag += axis_scale;
+                a = -axis_scale;
+            } else if (type == GRID_AIR) {
+                cell.a_diag += axis_scale;
+            }
+        };
+
+        if (c.x > 0)
+            lower({-1, 0, 0});
+        if (c.x < d.x - 2)
+            upper({1, 0, 0}, cell.a_x);
+        if (c.y > 0)
+            lower({0, -1, 0});
+        if (c.y < d.y - 2)
+            upper({0, 1, 0}, cell.a_y);
+        if (c.z > 0)
+            lower({0, 0, -1});
+        if (c.z < d.z - 2)
+            upper({0, 0, 1}, cell.a_z);
+    }
+
+    void setup_grid_project(float dt) {
+        for_each_cell([&](const glm::ivec3& c, int i) {
+            compute_divergence(c, i);
+            build_a(c, i, dt);
+        });
+    }
+
+    void pressure_solve() {
+        if (pressure_solver == PressureSolver::PCG) {
+            pcg.solve(pool, *this, grid.data());
+        } else {
+            pressure_solve_jacobi();
+        }
+    }
+
+    void pressure_solve_jacobi() {
+        const glm::ivec3& d = grid_dimensions;
+        for (int iter = 0; iter < jacobi_iterations; ++iter) {
+            for_each_cell([&](const glm::ivec3& c, int i) {
+                GridCell& cell = grid[i];
+                if (cell.type != GRID_FLUID) {
+                    cell.pressure = 0;
+                    return;
+                }
+
+                float L_Up = 0;
+                if (c.x > 0) {
+                    const GridCell& j = grid[get_grid_index(c + glm::ivec3(-1, 0, 0))];
+                    L_Up += j.a_x * j.pressure_guess;
+                }
+                if (c.y > 0) {
+                    const GridCell& j = grid[get_grid_index(c + glm::ivec3(0, -1, 0))];
+                    L_Up += j.a_y * j.pressure_guess;
+                }
+                if (c.z > 0) {
+                    const GridCell& j = grid[get_grid_index(c + glm::ivec3(0, 0, -1))];
+                    L_Up += j.a_z * j.pressure_guess;
+                }
+                if (c.x < d.x - 2)
+                    L_Up += cell.a_x * grid[get_grid_index(c + glm::ivec3(1, 0, 0))].pressure_guess;
+                if (c.y < d.y - 2)
+                    L_Up += cell.a_y * grid[get_grid_index(c + glm::ivec3(0, 1, 0))].pressure_guess;
+                if (c.z < d.z - 2)
+                    L_Up += cell.a_z * grid[get_grid_index(c + glm::ivec3(0, 0, 1))].pressure_guess;
+
+                if (cell.a_diag != 0)
+                    cell.pressure = 1.0f / cell.a_diag * (cell.rhs - L_Up);
+            });
+
+            for_each_cell([&](const glm::ivec3&, int i) {
+                grid[i].pressure_guess = grid[i].pressure;
+            });
+        }
+    }
+
+    void pressure_update(float dt) {
+        const glm::ivec3& d = grid_dimensions;
+        // pressure gradient along each axis over that axis's cell size
+        const glm::vec3 scale = dt / (density * cell_size);
+
+        for_each_cell([&](const glm::ivec3& c, int i) {
+            GridCell& cell = grid[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                glm::ivec3 offset(0);
+                offset[axis] = -1;
+                const GridCell& neighbor = grid[get_grid_index(c + offset)];
+                if (cell.type == GRID_FLUID or neighbor.type == GRID_FLUID) {
+                    // check solid
+                    if (c[axis] == 0 or c[axis] == d[axis] - 1) {
+                        cell.vel[axis] = 0;
+                    } else {
+                        cell.vel[axis] -= scale[axis] * (cell.pressure - neighbor.pressure);
+                    }
+                } else {
+                    cell.vel_unknown = 1;
+                }
+            }
+        });
+
+        // hack to tempfix bug for demo (see pressure_update.cs.glsl)
+        for_each_cell([&](const glm::ivec3& c, int i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                if (c[axis] == d[axis] - 1) {
+                    glm::ivec3 offset(0);
+                    offset[axis] = -1;
+                    grid[i].vel[axis] = grid[get_grid_index(c + offset)].vel[axis];
+                }
+            }
+        });
+    }
+
+    void grid_to_particle() {
+        g2p.run(pool, *this, grid.data(), particles.data(), particles.size(), pic_flip_blend);
+    }
+
+    static glm::vec3 hash3(glm::uvec3 x) {
+        // port of rand.glsl
+        const unsigned int k = 1103515245U;
+        x = ((x >> 8U) ^ glm::uvec3(x.y, x.z, x.x)) * k;
+        x = ((x >> 8U) ^ glm::uvec3(x.y, x.z, x.x)) * k;
+        x = ((x >> 8U) ^ glm::uvec3(x.y, x.z, x.x)) * k;
+        return glm::vec3(x) * (1.0f / float(0xffffffffU));
+    }
+
+    static bool ray_sphere_isect(const glm::vec3& r0, const glm::vec3& rd, const glm::vec3& s0, float sr) {
+        const float a = glm::dot(rd, rd);
+        const glm::vec3 s0_r0 = r0 - s0;
+        const float b = 2.0f * glm::dot(rd, s0_r0);
+        const float c = glm::dot(s0_r0, s0_r0) - (sr * sr);
+        return b*b - 4.0f*a*c >= 0.0f;
+    }
+
+    void particle_advect(float dt) {
+        const float mouse_range = 0.25;
+        const float jitter = 0.005;
+        const glm::vec3 epsilon(0.00001);
+        const glm::vec3 mouse_dir = glm::normalize(world_mouse_pos - eye);
+
+        pool.parallel_for(0, particles.size(), [&](int i) {
+            Particle& p = particles[i];
+            p.pos += p.vel * dt;
+
+            // jitter particle positions to prevent squishing
+            glm::uvec3 bits;
+            std::memcpy(&bits, &p.pos, sizeof(bits));
+            p.pos += hash3(bits) * jitter - 0.5f * jitter;
+
+            p.pos = glm::clamp(p.pos, bounds_min + epsilon, bounds_max - epsilon);
+
+            if (ray_sphere_isect(world_mouse_pos, mouse_dir, p.pos, mouse_range))
+                p.vel += world_mouse_vel;
+        });
+    }
+
+    /**
+     * Fastest velocity component next to the fluid, in cells per second;
+     * mirrors max_speed.cs.glsl.
+     */
+    float max_cell_speed() const {
+        float max_speed = 0;
+        for (int i = 0; i < num_cells(); ++i) {
+            const glm::ivec3 c = get_grid_coord_from_index(i);
+            for (int axis = 0; axis < 3; ++axis) {
+                glm::ivec3 lower = c;
+                lower[axis] -= 1;
+                if (grid[i].type == GRID_FLUID or (lower[axis] >= 0 and grid[get_grid_index(lower)].type == GRID_FLUID))
+                    max_speed = std::max(max_speed, std::abs(grid[i].vel[axis]) / cell_size[axis]);
+            }
+        }
+        return max_speed;
+    }
+
+    void step(float dt) {
+        particle_to_grid();
+        apply_body_forces(dt);
+        setup_grid_project(dt);
+        pressure_solve();
+        pressure_update(dt);
+        grid_to_particle();
+        particle_advect(dt);
+    }
+};
+}
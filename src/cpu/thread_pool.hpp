@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu {
+/**
+ * Reusable barrier for the threads of a single ThreadPool::run() call, for
+ * tasks that need many cheap synchronization points (e.g. wavefront sweeps)
+ * where a separate run() per phase would cost too much.
+ */
+class SpinBarrier {
+    const int count;
+    std::atomic<int> waiting{0};
+    std::atomic<unsigned> phase{0};
+
+public:
+    explicit SpinBarrier(int count) : count(count) {}
+
+    void wait() {
+        const unsigned current = phase.load(std::memory_order_acquire);
+        if (waiting.fetch_add(1, std::memory_order_acq_rel) == count - 1) {
+            waiting.store(0, std::memory_order_relaxed);
+            phase.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        while (phase.load(std::memory_order_acquire) == current) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+/**
+ * Fixed-size pool of worker threads for fork-join style data parallelism.
+ *
+ * run() executes a task once on every thread (the calling thread takes part
+ * as thread 0) and returns when all of them have finished, so tasks may freely
+ * use per-thread scratch storage indexed by the thread number.
+ */
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const std::function<void(int)>* task = nullptr;
+    unsigned long generation = 0;
+    int pending = 0;
+    bool stopping = false;
+
+    void worker_loop(int thread_index) {
+        unsigned long seen_generation = 0;
+        while (true) {
+            const std::function<void(int)>* current_task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&]{ return stopping or generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+                current_task = task;
+            }
+
+            (*current_task)(thread_index);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                done_cv.notify_one();
+        }
+    }
+
+public:
+    /**
+     * @param num_threads total thread count including the caller; 0 uses all hardware threads
+     */
+    explicit ThreadPool(int num_threads = 0) {
+        if (num_threads <= 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 1; i < num_threads; ++i) {
+            workers.emplace_back(&ThreadPool::worker_loop, this, i);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * Call fn(thread_index) once on each thread and wait for all calls to return.
+     */
+    void run(const std::function<void(int)>& fn) {
+        if (workers.empty()) {
+            fn(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &fn;
+            pending = workers.size();
+            ++generation;
+        }
+        start_cv.notify_all();
+
+        fn(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&]{ return pending == 0; });
+    }
+
+    /**
+     * Split [begin, end) into one contiguous chunk per thread and call
+     * fn(chunk_begin, chunk_end, thread_index) for each non-empty chunk.
+     */
+    template <typename F>
+    void parallel_for_range(int begin, int end, F fn) {
+        const int n = end - begin;
+        if (n <= 0)
+            return;
+        const int num_chunks = std::min(size(), n);
+        if (num_chunks == 1) {
+            fn(begin, end, 0);
+            return;
+        }
+        run([&](int thread_index) {
+            if (thread_index >= num_chunks)
+                return;
+            const int lo = begin + static_cast<long long>(n) * thread_index / num_chunks;
+            const int hi = begin + static_cast<long long>(n) * (thread_index + 1) / num_chunks;
+            fn(lo, hi, thread_index);
+        });
+    }
+
+    /**
+     * Call fn(i) for every i in [begin, end), in parallel.
+     */
+    template <typename F>
+    void parallel_for(int begin, int end, F fn) {
+        parallel_for_range(begin, end, [&](int lo, int hi, int) {
+            for (int i = lo; i < hi; ++i) {
+                fn(i);
+            }
+        });
+    }
+};
+}
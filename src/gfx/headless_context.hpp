@@ -0,0 +1,135 @@
+#pragma once
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glad/glad.h>
+
+namespace gfx {
+/**
+ * An offscreen OpenGL context created through EGL, for running compute work
+ * on machines without a display server.
+ *
+ * Display selection prefers Mesa's surfaceless platform (works with llvmpipe
+ * on machines without a GPU), then the first EGL device (headless NVIDIA),
+ * then the default display. The context is made current on construction.
+ *
+ * A context created with share shares buffers, programs and sync objects with
+ * that one, for GL work on another thread; it's made current on the thread
+ * that creates it.
+ */
+class HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    bool owns_display = true; // false for contexts sharing another's display
+
+    static bool has_extension(const char* extensions, const char* name) {
+        if (!extensions)
+            return false;
+        const size_t len = strlen(name);
+        for (const char* p = strstr(extensions, name); p; p = strstr(p + len, name)) {
+            if ((p == extensions or p[-1] == ' ') and (p[len] == ' ' or p[len] == '\0'))
+                return true;
+        }
+        return false;
+    }
+
+    static void check(bool ok, const std::string& what) {
+        if (!ok) {
+            std::stringstream str;
+            str << what << " failed (EGL error 0x" << std::hex << eglGetError() << ")";
+            throw std::runtime_error(str.str());
+        }
+    }
+
+    void open_display() {
+        const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+        if (get_platform_display and has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY and eglInitialize(display, nullptr, nullptr))
+                return;
+        }
+
+        auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+        if (get_platform_display and query_devices and has_extension(client_extensions, "EGL_EXT_platform_device")) {
+            EGLDeviceEXT device;
+            EGLint num_devices = 0;
+            if (query_devices(1, &device, &num_devices) and num_devices > 0) {
+                display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+                if (display != EGL_NO_DISPLAY and eglInitialize(display, nullptr, nullptr))
+                    return;
+            }
+        }
+
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        check(display != EGL_NO_DISPLAY, "eglGetDisplay");
+        check(eglInitialize(display, nullptr, nullptr), "eglInitialize");
+    }
+
+public:
+    HeadlessContext(int major = 4, int minor = 3, const HeadlessContext* share = nullptr) {
+        if (share) {
+            display = share->display;
+            owns_display = false;
+        } else {
+            open_display();
+        }
+        const EGLContext share_context = share ? share->context : EGL_NO_CONTEXT;
+        check(eglBindAPI(EGL_OPENGL_API), "eglBindAPI");
+
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (has_extension(extensions, "EGL_KHR_no_config_context") and has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+            context = eglCreateContext(display, EGL_NO_CONFIG_KHR, share_context, context_attribs);
+            check(context != EGL_NO_CONTEXT, "eglCreateContext");
+        } else {
+            // no surfaceless support; render into a dummy 1x1 pbuffer instead
+            const EGLint config_attribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+            };
+            EGLConfig config;
+            EGLint num_configs = 0;
+            check(eglChooseConfig(display, config_attribs, &config, 1, &num_configs) and num_configs > 0, "eglChooseConfig");
+
+            const EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+            check(surface != EGL_NO_SURFACE, "eglCreatePbufferSurface");
+            context = eglCreateContext(display, config, share_context, context_attribs);
+            check(context != EGL_NO_CONTEXT, "eglCreateContext");
+        }
+
+        make_current();
+        if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))
+            throw std::runtime_error("gladLoadGL failed");
+    }
+
+    ~HeadlessContext() {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) { eglDestroyContext(display, context); }
+        if (surface != EGL_NO_SURFACE) { eglDestroySurface(display, surface); }
+        if (owns_display) { eglTerminate(display); }
+    }
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    void make_current() {
+        check(eglMakeCurrent(display, surface, surface, context), "eglMakeCurrent");
+    }
+};
+}
@@ -71,6 +71,33 @@ public:
         _size = data.size() * sizeof(T);
     } 
 
+    /**
+     * Allocate storage for length elements of T, leaving the contents undefined.
+     */
+    template <typename T>
+    void allocate(int length, GLenum usage = GL_DYNAMIC_COPY) {
+        create();
+        glBindBuffer(target, id);
+        glBufferData(target, sizeof(T) * length, nullptr, usage);
+        glBindBuffer(target, 0); // unbind
+        _length = length;
+        _size = length * sizeof(T);
+    }
+
+    /**
+     * Overwrite the buffer contents in place, reallocating only if the size changed.
+     */
+    template <typename T>
+    void update_data(const std::vector<T>& data, GLenum usage = GL_DYNAMIC_DRAW) {
+        if (!id or sizeof(T) * data.size() != static_cast<size_t>(_size)) {
+            set_data(data, usage);
+            return;
+        }
+        glBindBuffer(target, id);
+        glBufferSubData(target, 0, sizeof(T) * data.size(), data.data());
+        glBindBuffer(target, 0); // unbind
+    }
+
 private:
     struct GlMappedBufferDeleter {
         GLenum target;
@@ -45,6 +45,14 @@ public:
         return *this;
     }
 
+    /**
+     * Add a preprocessor definition to the shaders compiled after this call
+     */
+    Program& define(const std::string& macro, const std::string& value) {
+        defines += "#define " + macro + " " + value + "\n";
+        return *this;
+    }
+
     void compile_shader(std::initializer_list<std::string> srcs, GLuint& dest, GLenum type, std::string type_name) {
         std::string src = read_sources(srcs);
         dest = glCreateShader(type);
@@ -106,12 +114,14 @@ public:
     GLuint compute_id = 0;
 
 private:
+    std::string defines; // inserted after shader_prepend
+
     /**
      * Read and concatenate shader sources from the shader_root
      */
     std::string read_sources(std::initializer_list<std::string> srcs) {
         std::stringstream result;
-        result << shader_prepend;
+        result << shader_prepend << defines;
         for (auto& src : srcs) {
             result << file_read(shader_root + "/" + src) << std::endl;
         }
@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glad/glad.h>
+#include "gfx/headless_context.hpp"
+#include "Fluid.hpp"
+#include "SimulationThread.hpp"
+
+/**
+ * Runs the simulation without a window, for batch runs and benchmarking on
+ * machines without a display (or without a GPU, using llvmpipe).
+ */
+
+struct Options {
+    int steps = 100;
+    int warmup = 5;
+    FluidConfig config; // grid, domain and time step
+    Fluid::Backend backend = Fluid::Backend::GPU;
+    int cpu_threads = 0;
+    std::string solver; // empty for the backend's default
+    float pcg_tolerance = -1; // -1 for the solver's default
+    int pcg_max_iterations = -1;
+    float sor_omega = -1;
+    bool report = false; // print solver statistics for every step
+    int particle_group_size = 256;
+    bool fuse_g2p_advect = true;
+    int sort_interval = -1;
+    std::string p2g = "scatter";
+    bool sparse_grid = false;
+    bool indirect_dispatch = false;
+    int narrow_band = -1; // band width, -1 to keep particles everywhere
+    float cfl = -1; // CFL number for adaptive substeps, -1 for one step of dt
+    int max_substeps = 8;
+    bool async = false; // simulate on a worker thread with its own context
+};
+
+void print_usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " [options]\n"
+              << "  --steps N     number of timed simulation steps (default 100)\n"
+              << "  --warmup N    untimed steps before measuring (default 5)\n"
+              << "  --grid N      grid cells along each axis, or X,Y,Z per axis (default 24)\n"
+              << "  --bounds-min X,Y,Z  domain corners (default -1,-1,-1 and 1,1,1); cells can be\n"
+              << "  --bounds-max X,Y,Z  longer along some axes\n"
+              << "  --cell-size H size of the cells, or X,Y,Z per axis, instead of --grid\n"
+              << "  --dt X        time step in seconds, or frame time with --cfl (default 0.02)\n"
+              << "  --config FILE read the above from key = value lines (see FluidConfig.hpp)\n"
+              << "  --density N   particles seeded per fluid cell (default 8)\n"
+              << "  --cpu         simulate on the CPU instead of with compute shaders\n"
+              << "  --threads N   CPU backend thread count (default: all hardware threads)\n"
+              << "  --solver S    pressure solver: jacobi or pcg (MIC(0) preconditioned) with --cpu (default pcg),\n"
+              << "                jacobi, rbgs (red-black Gauss-Seidel), chebyshev (accelerated Jacobi),\n"
+              << "                cg, jpcg (Jacobi preconditioned) or mgpcg otherwise (default jacobi)\n"
+              << "  --tolerance X conjugate gradient relative residual tolerance (default 1e-5 CPU, 1e-4 GPU)\n"
+              << "  --max-iters N conjugate gradient iteration limit (default 200),\n"
+              << "                or GPU jacobi/rbgs/chebyshev iteration count (default 40)\n"
+              << "  --omega X     rbgs over-relaxation factor (default 1)\n"
+              << "  --report      print pressure solver iterations and residual for every step\n"
+              << "  --particle-group N  workgroup size of particle kernels (default 256)\n"
+              << "  --no-fuse     run grid to particle transfer and advection as separate passes\n"
+              << "  --sort-interval N  steps between particle sorts by grid cell, 0 to never sort (default 10)\n"
+              << "  --p2g M       particle to grid transfer: scatter (float atomics), gather (sorted, atomic-free)\n"
+              << "                or shared (sorted, accumulated per tile in shared memory)\n"
+              << "  --sparse      run grid kernels only over the 8^3 bricks around the particles\n"
+              << "  --indirect    size grid and particle dispatches on the GPU from the fluid's bounding box\n"
+              << "  --narrow-band N  keep particles only within N cells of the surface, carrying the interior on the grid\n"
+              << "  --cfl X       time each step as a frame of dt, in substeps crossing at most X cells\n"
+              << "  --max-substeps N  substep limit for --cfl (default 8)\n"
+              << "  --async       simulate on a worker thread with a shared context while this thread\n"
+              << "                takes its finished frames, as the viewer does with --async\n";
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto next_int = [&]() {
+            if (i + 1 >= argc) { throw std::runtime_error("Missing value for " + arg); }
+            return std::stoi(argv[++i]);
+        };
+        auto next_string = [&]() {
+            if (i + 1 >= argc) { throw std::runtime_error("Missing value for " + arg); }
+            return std::string(argv[++i]);
+        };
+
+        if (arg == "--steps") { options.steps = next_int(); }
+        else if (arg == "--warmup") { options.warmup = next_int(); }
+        else if (arg == "--config") { options.config.load(next_string()); }
+        else if (arg == "--density") { options.config.set("particle_density", next_string()); }
+        else if (FluidConfig::is_option(arg)) { options.config.set_option(arg, next_string()); }
+        else if (arg == "--cpu") { options.backend = Fluid::Backend::CPU; }
+        else if (arg == "--threads") { options.cpu_threads = next_int(); }
+        else if (arg == "--solver") { options.solver = next_string(); }
+        else if (arg == "--tolerance") { options.pcg_tolerance = std::stof(next_string()); }
+        else if (arg == "--max-iters") { options.pcg_max_iterations = next_int(); }
+        else if (arg == "--omega") { options.sor_omega = std::stof(next_string()); }
+        else if (arg == "--report") { options.report = true; }
+        else if (arg == "--particle-group") { options.particle_group_size = next_int(); }
+        else if (arg == "--no-fuse") { options.fuse_g2p_advect = false; }
+        else if (arg == "--sort-interval") { options.sort_interval = next_int(); }
+        else if (arg == "--p2g") { options.p2g = next_string(); }
+        else if (arg == "--sparse") { options.sparse_grid = true; }
+        else if (arg == "--indirect") { options.indirect_dispatch = true; }
+        else if (arg == "--narrow-band") { options.narrow_band = next_int(); }
+        else if (arg == "--cfl") { options.cfl = std::stof(next_string()); }
+        else if (arg == "--max-substeps") { options.max_substeps = next_int(); }
+        else if (arg == "--async") { options.async = true; }
+        else if (arg == "-h" or arg == "--help") {
+            print_usage(argv[0]);
+            std::exit(0);
+        } else {
+            print_usage(argv[0]);
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+    options.config.resolve(); // throws for sizes the simulation can't use
+    if (options.steps < 1 or options.warmup < 0 or options.cpu_threads < 0 or (options.pcg_tolerance < 0 and options.pcg_tolerance != -1) or options.pcg_max_iterations < -1 or (options.sor_omega != -1 and (options.sor_omega <= 0 or options.sor_omega >= 2)) or options.particle_group_size < 1 or options.sort_interval < -1 or (options.cfl <= 0 and options.cfl != -1) or options.max_substeps < 1) {
+        throw std::runtime_error("Invalid option value");
+    }
+    const bool cpu = options.backend == Fluid::Backend::CPU;
+    const bool gpu_cg = options.solver == "cg" or options.solver == "jpcg" or options.solver == "mgpcg";
+    if (!options.solver.empty() and options.solver != "jacobi" and (cpu ? options.solver != "pcg" : !gpu_cg and options.solver != "rbgs" and options.solver != "chebyshev")) {
+        throw std::runtime_error("Unknown solver for the " + std::string(cpu ? "cpu" : "gpu") + " backend: " + options.solver);
+    }
+    if (options.p2g != "scatter" and options.p2g != "gather" and options.p2g != "shared") {
+        throw std::runtime_error("Unknown particle to grid transfer: " + options.p2g);
+    }
+    return options;
+}
+
+void GLAPIENTRY
+MessageCallback(GLenum source,
+    GLenum type,
+    GLuint id,
+    GLenum severity,
+    GLsizei length,
+    const GLchar* message,
+    const void* userParam)
+{
+    if (type == GL_DEBUG_TYPE_ERROR) {
+        fprintf(stderr, "GL CALLBACK: ERROR! type = 0x%x, severity = 0x%x, message = %s\n", type, severity, message);
+        throw std::runtime_error("GL High Severity error");
+    }
+}
+
+int main(int argc, char** argv) {
+    const Options options = parse_options(argc, argv);
+
+    gfx::HeadlessContext context(4, 3);
+    std::cout << "** GL Version: " << GLVersion.major << "." << GLVersion.minor << std::endl;
+    std::cout << "** GL Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(MessageCallback, 0);
+
+    // Fluid owns GL objects, so it has to be created after the context
+    auto fluid = std::make_unique<Fluid>(options.config, options.backend, options.cpu_threads);
+    fluid->particle_group_size = options.particle_group_size;
+    if (options.cfl > 0) {
+        fluid->cfl_number = options.cfl;
+        fluid->max_substeps = options.max_substeps;
+    }
+    fluid->fuse_g2p_advect = options.fuse_g2p_advect;
+    fluid->sparse_grid = options.sparse_grid;
+    fluid->indirect_dispatch = options.indirect_dispatch;
+    if (options.narrow_band >= 0) {
+        fluid->narrow_band = true;
+        fluid->narrow_band_width = options.narrow_band;
+    }
+    std::unique_ptr<gfx::HeadlessContext> simulation_context; // created and made current on the worker thread
+    std::unique_ptr<SimulationThread> simulation;
+    if (options.async) {
+        if (options.cfl <= 0) {
+            fluid->max_substeps = 1; // the worker runs frames of step_frame(), make them single steps
+        }
+        simulation = std::make_unique<SimulationThread>(*fluid,
+            [&]() { simulation_context = std::make_unique<gfx::HeadlessContext>(4, 3, &context); },
+            [&]() { simulation_context.reset(); });
+        simulation->start();
+        fluid->init_rendering();
+    } else {
+        fluid->init();
+    }
+    if (fluid->cpu_sim) {
+        if (options.solver == "jacobi") { fluid->cpu_sim->pressure_solver = cpu::Simulation::PressureSolver::JACOBI; }
+        if (options.pcg_tolerance >= 0) { fluid->cpu_sim->pcg.tolerance = options.pcg_tolerance; }
+        if (options.pcg_max_iterations >= 0) { fluid->cpu_sim->pcg.max_iterations = options.pcg_max_iterations; }
+    } else {
+        if (options.solver == "rbgs") { fluid->pressure_solver = Fluid::PressureSolver::RED_BLACK_GS; }
+        if (options.solver == "chebyshev") { fluid->pressure_solver = Fluid::PressureSolver::CHEBYSHEV; }
+        if (options.solver == "cg" or options.solver == "jpcg" or options.solver == "mgpcg") { fluid->pressure_solver = Fluid::PressureSolver::CG; }
+        if (options.solver == "cg") { fluid->pressure_cg.preconditioner = PressureCG::Preconditioner::NONE; }
+        if (options.solver == "jpcg") { fluid->pressure_cg.preconditioner = PressureCG::Preconditioner::JACOBI; }
+        if (options.pcg_tolerance >= 0) { fluid->pressure_cg.tolerance = options.pcg_tolerance; }
+        if (options.pcg_max_iterations >= 0) {
+            fluid->pressure_cg.max_iterations = options.pcg_max_iterations;
+            fluid->pressure_iterations = options.pcg_max_iterations;
+        }
+        if (options.sor_omega >= 0) { fluid->sor_omega = options.sor_omega; }
+        if (options.sort_interval >= 0) { fluid->sort_interval = options.sort_interval; }
+        if (options.p2g == "gather") { fluid->p2g_mode = Fluid::P2GMode::GATHER; }
+        if (options.p2g == "shared") { fluid->p2g_mode = Fluid::P2GMode::SHARED; }
+    }
+
+    // conjugate gradient statistics of the last step, if one of those solvers is in use
+    const bool cpu_pcg = fluid->cpu_sim and fluid->cpu_sim->pressure_solver == cpu::Simulation::PressureSolver::PCG;
+    const bool gpu_cg = !fluid->cpu_sim and fluid->pressure_solver == Fluid::PressureSolver::CG;
+    auto solver_iterations = [&]() { return cpu_pcg ? fluid->cpu_sim->pcg.iterations : fluid->pressure_cg.iterations; };
+    auto solver_residual = [&]() { return cpu_pcg ? fluid->cpu_sim->pcg.residual : fluid->pressure_cg.residual; };
+    // with --cfl, every timed step is a frame of adaptive substeps
+    auto advance = [&]() {
+        if (options.cfl > 0) {
+            fluid->step_frame();
+        } else {
+            fluid->step();
+        }
+    };
+
+    using clock = std::chrono::steady_clock;
+    if (simulation) {
+        // this thread stands in for the viewer's render loop, taking every finished frame it can
+        auto run_frames = [&](int n) {
+            const long target = simulation->frames() + n;
+            simulation->request_frames(n);
+            while (simulation->frames() < target) {
+                simulation->acquire();
+                simulation->release();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+        run_frames(options.warmup);
+        const long drawn_before = simulation->snapshots_drawn();
+        const auto start = clock::now();
+        run_frames(options.steps);
+        const double total_s = std::chrono::duration<double>(clock::now() - start).count();
+        const long drawn = simulation->snapshots_drawn() - drawn_before;
+        simulation->stop();
+        simulation->acquire(); // the last frame
+        glFinish();
+
+        std::cout << (options.backend == Fluid::Backend::CPU ? "cpu" : "gpu") << " backend, async, "
+                  << "grid " << fluid->grid_cell_dimensions.x << "x" << fluid->grid_cell_dimensions.y << "x" << fluid->grid_cell_dimensions.z << ", "
+                  << fluid->particle_ssbo.length() << " particles, "
+                  << options.steps << " frames in " << total_s << " s" << std::endl;
+        std::cout << "frames/sec: " << options.steps / total_s << std::endl;
+        std::cout << "snapshots taken: " << drawn << " of " << options.steps << " frames" << std::endl;
+        return 0;
+    }
+
+    for (int i = 0; i < options.warmup; ++i) {
+        advance();
+    }
+    fluid->ssbo_barrier();
+    glFinish();
+
+    std::vector<double> step_ms;
+    step_ms.reserve(options.steps);
+    long pcg_iterations = 0;
+    int pcg_max_iterations = 0;
+    long substeps = 0;
+    int max_substeps = 0;
+    const auto start = clock::now();
+    for (int i = 0; i < options.steps; ++i) {
+        const auto step_start = clock::now();
+        advance();
+        fluid->ssbo_barrier();
+        glFinish(); // wait for the GPU so each step is timed in full
+        step_ms.push_back(std::chrono::duration<double, std::milli>(clock::now() - step_start).count());
+        substeps += fluid->substeps;
+        max_substeps = std::max(max_substeps, fluid->substeps);
+        if (cpu_pcg or gpu_cg) {
+            pcg_iterations += solver_iterations();
+            pcg_max_iterations = std::max(pcg_max_iterations, solver_iterations());
+            if (options.report) {
+                std::cout << "step " << i << ": " << solver_iterations() << " iterations, residual " << solver_residual() << std::endl;
+            }
+        }
+    }
+    const double total_s = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::sort(step_ms.begin(), step_ms.end());
+    double sum_ms = 0;
+    for (double ms : step_ms) { sum_ms += ms; }
+
+    std::cout << (options.backend == Fluid::Backend::CPU ? "cpu" : "gpu") << " backend, "
+              << "grid " << fluid->grid_cell_dimensions.x << "x" << fluid->grid_cell_dimensions.y << "x" << fluid->grid_cell_dimensions.z << ", "
+              << fluid->particle_ssbo.length() << " particles, "
+              << options.steps << " steps in " << total_s << " s" << std::endl;
+    std::cout << "steps/sec: " << options.steps / total_s << std::endl;
+    std::cout << "step ms: mean " << sum_ms / step_ms.size()
+              << ", min " << step_ms.front()
+              << ", median " << step_ms[step_ms.size() / 2]
+              << ", max " << step_ms.back() << std::endl;
+    if (fluid->indirect_dispatch) {
+        const FluidExtent::Extent extent = fluid->fluid_extent.read();
+        std::cout << "active cells: " << extent.num_active_cells << " of " << glm::compMul(fluid->grid_dimensions) << std::endl;
+    }
+    if (options.cfl > 0) {
+        std::cout << "substeps/frame: " << static_cast<double>(substeps) / options.steps << ", max " << max_substeps << std::endl;
+    }
+    if (fluid->narrow_band) {
+        const FluidExtent::Extent extent = fluid->fluid_extent.read();
+        std::cout << "particles in use: " << extent.num_particles << " of " << fluid->particle_ssbo.length() << std::endl;
+    }
+    if (fluid->sparse_grid) {
+        std::cout << "active bricks: " << fluid->active_bricks.active_bricks() << " of " << fluid->active_bricks.num_bricks << std::endl;
+    }
+    if (cpu_pcg or gpu_cg) {
+        std::cout << "pcg iterations/step: " << static_cast<double>(pcg_iterations) / options.steps
+                  << ", max " << pcg_max_iterations
+                  << ", last residual " << solver_residual() << std::endl;
+    }
+}
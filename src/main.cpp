@@ -1,5 +1,6 @@
 #include <iostream>
 #include <sstream>
+#include <string>
 #include <exception>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -46,7 +47,11 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             game->particles_visible = !game->particles_visible;
         }
         if (key == GLFW_KEY_G) {
-            game->grid_visible = !game->grid_visible;
+            if (game->simulation) {
+                std::cout << "The grid view isn't available with --async" << std::endl;
+            } else {
+                game->grid_visible = !game->grid_visible;
+            }
         }
         if (key == GLFW_KEY_SPACE) {
             game->running = !game->running;
@@ -55,27 +60,33 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             game->do_step = true;
         }
         if (key == GLFW_KEY_R) {
-            game->fluid.init_ssbos();
+            game->do_reset = true;
         }
         if (key == GLFW_KEY_F) {
             game->use_ssf = !game->use_ssf;
         }
+        if (key == GLFW_KEY_U) {
+            const bool uncapped = game->scheduler.mode != FrameScheduler::Mode::UNCAPPED;
+            game->scheduler.mode = uncapped ? FrameScheduler::Mode::UNCAPPED : FrameScheduler::Mode::REAL_TIME;
+            glfwSwapInterval(uncapped ? 0 : 1); // vsync would cap the uncapped mode at the refresh rate
+            std::cout << (uncapped ? "Uncapped simulation" : "Real time simulation") << std::endl;
+        }
 
         if (key == GLFW_KEY_PAGE_DOWN) {
-            game->fluid.pic_flip_blend = std::max(0.f, game->fluid.pic_flip_blend - 0.05f);
-            std::cout << "PIC/FLIP blend " << game->fluid.pic_flip_blend << std::endl;
+            game->pic_flip_blend = std::max(0.f, game->pic_flip_blend - 0.05f);
+            std::cout << "PIC/FLIP blend " << game->pic_flip_blend << std::endl;
         }
         if (key == GLFW_KEY_PAGE_UP) {
-            game->fluid.pic_flip_blend = std::min(1.f, game->fluid.pic_flip_blend + 0.05f);
-            std::cout << "PIC/FLIP blend " << game->fluid.pic_flip_blend << std::endl;
+            game->pic_flip_blend = std::min(1.f, game->pic_flip_blend + 0.05f);
+            std::cout << "PIC/FLIP blend " << game->pic_flip_blend << std::endl;
         }
         if (key == GLFW_KEY_HOME) {
-            game->fluid.pic_flip_blend = 0.9f;
-            std::cout << "PIC/FLIP blend " << game->fluid.pic_flip_blend << std::endl;
+            game->pic_flip_blend = 0.9f;
+            std::cout << "PIC/FLIP blend " << game->pic_flip_blend << std::endl;
         }
         if (key == GLFW_KEY_END) {
-            game->fluid.pic_flip_blend = 0.f;
-            std::cout << "PIC/FLIP blend " << game->fluid.pic_flip_blend << std::endl;
+            game->pic_flip_blend = 0.f;
+            std::cout << "PIC/FLIP blend " << game->pic_flip_blend << std::endl;
         }
 
         if (key == GLFW_KEY_1) {
@@ -130,7 +141,35 @@ void FramebufferSizeCallback(GLFWwindow* window, int w, int h) {
     game->resize(w, h);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // command line: [--cpu] [--threads N] [--config FILE] [FluidConfig options] [--uncapped] [--max-sim-frames N] [--async]
+    Fluid::Backend backend = Fluid::Backend::GPU;
+    int cpu_threads = 0;
+    FluidConfig config;
+    bool uncapped = false;
+    int max_sim_frames = -1;
+    bool async = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--cpu") {
+            backend = Fluid::Backend::CPU;
+        } else if (arg == "--threads" and i + 1 < argc) {
+            cpu_threads = std::stoi(argv[++i]);
+        } else if (arg == "--uncapped") {
+            uncapped = true;
+        } else if (arg == "--async") {
+            async = true;
+        } else if (arg == "--max-sim-frames" and i + 1 < argc) {
+            max_sim_frames = std::stoi(argv[++i]);
+        } else if (arg == "--config" and i + 1 < argc) {
+            config.load(argv[++i]);
+        } else if (FluidConfig::is_option(arg) and i + 1 < argc) {
+            config.set_option(arg, argv[++i]);
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+
     // setup glfw
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit()) { throw std::runtime_error("glfwInit failed"); }
@@ -140,6 +179,13 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     GLFWwindow* window = glfwCreateWindow(800, 800, "gl-pic-fluid", NULL, NULL);
     if (!window) { throw std::runtime_error("glfwCreateWindow failed"); }
+    GLFWwindow* simulation_window = nullptr;
+    if (async) {
+        // context for the simulation thread, sharing buffers and programs with the window's
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        simulation_window = glfwCreateWindow(1, 1, "gl-pic-fluid simulation", NULL, window);
+        if (!simulation_window) { throw std::runtime_error("glfwCreateWindow failed"); }
+    }
     glfwMakeContextCurrent(window);
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
     std::cout << "** GL Version: " << GLVersion.major << "." << GLVersion.minor << std::endl;
@@ -148,7 +194,7 @@ int main() {
     glGetIntegerv(GL_NV_shader_atomic_float, &supports_nv_atomic_float);
     std::cout << "NV_shader_atomic_float " << (supports_nv_atomic_float ? "IS" : "NOT") << " supported" << std::endl;
 
-    glfwSwapInterval(1); // enable vsync (0 to disable)
+    glfwSwapInterval(uncapped ? 0 : 1); // enable vsync (0 to disable)
 
     // Callback functions
     glfwSetKeyCallback(window, KeyCallback);
@@ -161,7 +207,14 @@ int main() {
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
     glDebugMessageCallback(MessageCallback, 0);
 
-    Game game(window);
+    Game game(window, config, backend, cpu_threads);
+    if (uncapped) {
+        game.scheduler.mode = FrameScheduler::Mode::UNCAPPED;
+    }
+    if (max_sim_frames > 0) {
+        game.scheduler.max_frames = max_sim_frames;
+    }
+    game.simulation_window = simulation_window;
     glfwSetWindowUserPointer(window, &game);
 
     game.init();
@@ -176,6 +229,10 @@ int main() {
         glfwPollEvents();
     }
 
+    if (game.simulation) {
+        game.simulation->stop();
+        glfwDestroyWindow(simulation_window);
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 }
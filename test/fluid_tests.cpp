@@ -1,6 +1,363 @@
 #include <gtest/gtest.h>
 #include "../src/Fluid.hpp"
+#include "../src/FrameScheduler.hpp"
 
 TEST(FluidTest, ConstructsWithoutError) {
     Fluid fluid;
 }
+
+TEST(ThreadPoolTest, ParallelForVisitsEachIndexOnce) {
+    cpu::ThreadPool pool(4);
+    std::vector<int> visits(1000, 0);
+    pool.parallel_for(0, visits.size(), [&](int i) { visits[i]++; });
+    for (int v : visits) {
+        EXPECT_EQ(v, 1);
+    }
+}
+
+TEST(CPUSimulationTest, ParticlesStayInBounds) {
+    const glm::ivec3 dim(9, 9, 9);
+    const glm::vec3 bounds_min(-1), bounds_max(1);
+    cpu::ThreadPool pool(2);
+    cpu::Simulation sim(dim, bounds_min, bounds_max, pool);
+
+    std::vector<GridCell> grid;
+    std::vector<Particle> particles;
+    for (int z = 0; z < dim.z; ++z) {
+        for (int y = 0; y < dim.y; ++y) {
+            for (int x = 0; x < dim.x; ++x) {
+                const glm::vec3 pos = sim.get_world_coord({x, y, z}, {0, 0, 0});
+                grid.emplace_back(pos, glm::vec3(0), x < 4 ? GRID_FLUID : GRID_AIR);
+                if (x < 4 and y < 8 and z < 8)
+                    particles.emplace_back(pos + sim.cell_size * 0.5f, glm::vec3(0), glm::vec4(1));
+            }
+        }
+    }
+    sim.reset(particles, grid);
+
+    auto mean_height = [&]() {
+        float sum = 0;
+        for (const Particle& p : sim.particles) { sum += p.pos.y; }
+        return sum / sim.particles.size();
+    };
+    const float initial_height = mean_height();
+
+    for (int i = 0; i < 10; ++i) {
+        sim.step(0.02);
+    }
+    for (const Particle& p : sim.particles) {
+        EXPECT_TRUE(glm::all(glm::greaterThanEqual(p.pos, bounds_min)));
+        EXPECT_TRUE(glm::all(glm::lessThanEqual(p.pos, bounds_max)));
+    }
+    EXPECT_LT(mean_height(), initial_height); // fluid column collapses under gravity
+}
+
+TEST(CPUParticleToGridTest, ResultIndependentOfThreadCount) {
+    const cpu::GridGeometry geom({13, 9, 11}, glm::vec3(-1), glm::vec3(1));
+    std::vector<Particle> particles;
+    for (int i = 0; i < 5000; ++i) {
+        particles.emplace_back(glm::linearRand(geom.bounds_min, geom.bounds_max), glm::ballRand(1.f), glm::vec4(1));
+    }
+
+    auto transfer = [&](int num_threads) {
+        cpu::ThreadPool pool(num_threads);
+        cpu::ParticleToGrid p2g;
+        std::vector<GridCell> grid(geom.num_cells(), GridCell(glm::vec3(0), glm::vec3(1), GRID_SOLID));
+        p2g.run(pool, geom, particles.data(), particles.size(), grid.data());
+        return grid;
+    };
+
+    const std::vector<GridCell> serial = transfer(1);
+    const std::vector<GridCell> parallel = transfer(5);
+    int fluid_cells = 0;
+    for (int i = 0; i < geom.num_cells(); ++i) {
+        EXPECT_EQ(serial[i].type, parallel[i].type);
+        EXPECT_NEAR(serial[i].vel.x, parallel[i].vel.x, 1e-4);
+        EXPECT_NEAR(serial[i].vel.y, parallel[i].vel.y, 1e-4);
+        EXPECT_NEAR(serial[i].vel.z, parallel[i].vel.z, 1e-4);
+        fluid_cells += serial[i].type == GRID_FLUID;
+    }
+    EXPECT_GT(fluid_cells, 0);
+}
+
+TEST(CPUGridToParticleTest, VectorKernelsMatchScalar) {
+    const cpu::GridGeometry geom({13, 9, 11}, glm::vec3(-1), glm::vec3(1));
+    std::vector<GridCell> grid;
+    for (int i = 0; i < geom.num_cells(); ++i) {
+        GridCell cell(glm::ballRand(1.f), glm::vec3(1), GRID_FLUID);
+        cell.old_vel = glm::ballRand(1.f);
+        grid.push_back(cell);
+    }
+    std::vector<Particle> particles;
+    for (int i = 0; i < 1003; ++i) { // not a multiple of the vector width
+        particles.emplace_back(glm::linearRand(geom.bounds_min, geom.bounds_max), glm::ballRand(1.f), glm::vec4(1));
+    }
+
+    cpu::ThreadPool pool(3);
+    auto transfer = [&](cpu::GridToParticle::Isa isa) {
+        cpu::GridToParticle g2p;
+        g2p.isa = isa;
+        std::vector<Particle> result = particles;
+        g2p.run(pool, geom, grid.data(), result.data(), result.size(), 0.9f);
+        return result;
+    };
+
+    using Isa = cpu::GridToParticle::Isa;
+    const std::vector<Particle> scalar = transfer(Isa::SCALAR);
+    const Isa best = cpu::GridToParticle::detect_isa();
+    for (Isa isa : {Isa::SSE41, Isa::AVX2}) {
+        if (isa > best)
+            continue;
+        const std::vector<Particle> vector = transfer(isa);
+        for (size_t i = 0; i < particles.size(); ++i) {
+            EXPECT_NEAR(scalar[i].vel.x, vector[i].vel.x, 1e-5) << cpu::GridToParticle::isa_name(isa);
+            EXPECT_NEAR(scalar[i].vel.y, vector[i].vel.y, 1e-5) << cpu::GridToParticle::isa_name(isa);
+            EXPECT_NEAR(scalar[i].vel.z, vector[i].vel.z, 1e-5) << cpu::GridToParticle::isa_name(isa);
+        }
+    }
+}
+
+TEST(CPUPressurePCGTest, ConvergesIndependentOfThreadCount) {
+    const glm::ivec3 dim(12, 10, 11);
+
+    auto solve = [&](int num_threads) {
+        cpu::ThreadPool pool(num_threads);
+        cpu::Simulation sim(dim, glm::vec3(-1), glm::vec3(1), pool);
+        std::srand(1); // same velocities for each thread count
+        for (int z = 0; z < dim.z; ++z) {
+            for (int y = 0; y < dim.y; ++y) {
+                for (int x = 0; x < dim.x; ++x) {
+                    const glm::vec3 vel = glm::linearRand(glm::vec3(-1), glm::vec3(1));
+                    sim.grid.emplace_back(sim.get_world_coord({x, y, z}, {0, 0, 0}), vel, y < 6 ? GRID_FLUID : GRID_AIR);
+                }
+            }
+        }
+        sim.setup_grid_project(0.02);
+        sim.pressure_solve();
+        EXPECT_GT(sim.pcg.iterations, 0);
+        EXPECT_LT(sim.pcg.iterations, sim.pcg.max_iterations);
+        return sim.grid;
+    };
+
+    const std::vector<GridCell> serial = solve(1);
+    const std::vector<GridCell> parallel = solve(4);
+    float max_pressure = 0;
+    for (size_t i = 0; i < serial.size(); ++i) {
+        max_pressure = std::max(max_pressure, std::abs(serial[i].pressure));
+    }
+    ASSERT_GT(max_pressure, 0);
+    for (size_t i = 0; i < serial.size(); ++i) {
+        EXPECT_NEAR(serial[i].pressure, parallel[i].pressure, 1e-3 * max_pressure);
+    }
+}
+
+TEST(EigenPressureSolverTest, ReusesPatternAndMatchesPCG) {
+    const glm::ivec3 dim(10, 9, 8);
+    cpu::ThreadPool pool(2);
+    cpu::Simulation sim(dim, glm::vec3(-1), glm::vec3(1), pool);
+    for (int z = 0; z < dim.z; ++z) {
+        for (int y = 0; y < dim.y; ++y) {
+            for (int x = 0; x < dim.x; ++x) {
+                const glm::vec3 vel = glm::linearRand(glm::vec3(-1), glm::vec3(1));
+                sim.grid.emplace_back(sim.get_world_coord({x, y, z}, {0, 0, 0}), vel, y < 5 ? GRID_FLUID : GRID_AIR);
+            }
+        }
+    }
+    sim.setup_grid_project(0.02);
+    sim.pcg.tolerance = 1e-6;
+    sim.pressure_solve();
+    const std::vector<GridCell> reference = sim.grid;
+
+    for (int direct_max_unknowns : {0, 100000}) {
+        cpu::EigenPressureSolver solver;
+        solver.direct_max_unknowns = direct_max_unknowns;
+        solver.tolerance = 1e-6;
+        for (int step = 0; step < 2; ++step) {
+            solver.solve(sim, sim.grid.data());
+            EXPECT_EQ(solver.pattern_rebuilt, step == 0);
+            EXPECT_EQ(solver.refactorized, step == 0);
+            for (size_t i = 0; i < reference.size(); ++i) {
+                EXPECT_NEAR(sim.grid[i].pressure, reference[i].pressure, 1e-3);
+            }
+        }
+    }
+}
+
+TEST(JacobiSpectrumTest, BoundsJacobiConvergenceRate) {
+    const glm::ivec3 dim(9, 10, 8);
+    cpu::ThreadPool pool(1);
+    cpu::Simulation sim(dim, glm::vec3(-1), glm::vec3(1), pool);
+    for (int z = 0; z < dim.z; ++z) {
+        for (int y = 0; y < dim.y; ++y) {
+            for (int x = 0; x < dim.x; ++x) {
+                sim.grid.emplace_back(sim.get_world_coord({x, y, z}, {0, 0, 0}), glm::vec3(0), y < 6 ? GRID_FLUID : GRID_AIR);
+            }
+        }
+    }
+    sim.setup_grid_project(0.02);
+    const float radius = cpu::estimate_jacobi_radius(sim, sim.grid.data());
+    EXPECT_GT(radius, 0.5);
+    EXPECT_LT(radius, 1);
+
+    // the error of Jacobi iterations on Ap = 0 shrinks by about the spectral radius per iteration
+    const int n = sim.grid.size();
+    const int strides[3] = {1, dim.x, dim.x * dim.y};
+    std::vector<float> p(n), next(n);
+    for (int i = 0; i < n; ++i) {
+        p[i] = sim.grid[i].type == GRID_FLUID and sim.grid[i].a_diag != 0 ? glm::linearRand(-1.f, 1.f) : 0;
+    }
+    float rate = 0;
+    for (int iteration = 0; iteration < 300; ++iteration) {
+        double norm = 0, next_norm = 0;
+        for (int i = 0; i < n; ++i) {
+            next[i] = 0;
+            if (sim.grid[i].type != GRID_FLUID or sim.grid[i].a_diag == 0)
+                continue;
+            const glm::ivec3 c = sim.get_grid_coord_from_index(i);
+            auto coefficient = [&](int j, int axis) {
+                return axis == 0 ? sim.grid[j].a_x : axis == 1 ? sim.grid[j].a_y : sim.grid[j].a_z;
+            };
+            float off = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (c[axis] > 0)
+                    off += coefficient(i - strides[axis], axis) * p[i - strides[axis]];
+                if (c[axis] < dim[axis] - 2)
+                    off += coefficient(i, axis) * p[i + strides[axis]];
+            }
+            next[i] = -off / sim.grid[i].a_diag;
+            norm += p[i] * p[i];
+            next_norm += next[i] * next[i];
+        }
+        rate = std::sqrt(next_norm / norm);
+        p.swap(next);
+    }
+    EXPECT_GE(radius, rate * 0.999);
+    EXPECT_LT(radius, rate + 0.02);
+}
+
+TEST(CompactParticleTest, RoundTripStaysInCell) {
+    const cpu::GridGeometry geom(glm::ivec3(17), glm::vec3(-1), glm::vec3(1));
+    srand(5);
+    for (int i = 0; i < 1000; ++i) {
+        const glm::vec3 pos = glm::linearRand(geom.bounds_min, geom.bounds_max);
+        const glm::vec3 vel = glm::linearRand(glm::vec3(-4), glm::vec3(4));
+        const CompactParticle p(geom, pos, vel, i % CompactParticle::palette_size, i);
+        const glm::vec3 decoded = p.pos(geom);
+        EXPECT_EQ(p.id, static_cast<std::uint32_t>(i));
+        EXPECT_EQ(p.palette_index(), static_cast<std::uint32_t>(i % CompactParticle::palette_size));
+        EXPECT_EQ(geom.get_grid_coord(decoded, glm::ivec3(0)), glm::clamp(geom.get_grid_coord(pos, glm::ivec3(0)), glm::ivec3(0), geom.grid_cell_dimensions - 1));
+        for (int axis = 0; axis < 3; ++axis) {
+            EXPECT_NEAR(decoded[axis], pos[axis], geom.cell_size[axis] / 65536.f + 1e-6f);
+            EXPECT_NEAR(p.vel()[axis], vel[axis], std::abs(vel[axis]) / 1024.f);
+        }
+    }
+}
+
+TEST(FluidConfigTest, ParsesKeysAndDerivesGridFromCellSize) {
+    FluidConfig config;
+    config.set_option("--grid", "256,64,128");
+    config.set("bounds_min", "-4 -1 -2");
+    config.set("bounds_max", "4");
+    config.set("dt", "0.01");
+    FluidConfig resolved = config.resolve();
+    EXPECT_EQ(resolved.grid, glm::ivec3(256, 64, 128));
+    EXPECT_EQ(resolved.bounds_min, glm::vec3(-4, -1, -2));
+    EXPECT_EQ(resolved.bounds_max, glm::vec3(4));
+    EXPECT_FLOAT_EQ(resolved.cell_size.x, 8.f / 256);
+    EXPECT_FLOAT_EQ(resolved.cell_size.y, 5.f / 64);
+    EXPECT_FLOAT_EQ(resolved.dt, 0.01f);
+
+    // cell_size wins over grid and rounds the domain to whole cells
+    config.set_option("--cell-size", "0.25, 0.5, 0.3");
+    resolved = config.resolve();
+    EXPECT_EQ(resolved.grid, glm::ivec3(32, 10, 20));
+    EXPECT_FLOAT_EQ(resolved.bounds_max.z, -2 + 20 * 0.3f);
+
+    EXPECT_FALSE(FluidConfig::is_option("--steps"));
+    EXPECT_THROW(config.set("grid_size", "8"), std::runtime_error);
+    EXPECT_THROW(config.set("grid", "8 8"), std::runtime_error);
+    EXPECT_THROW(config.set("dt", "fast"), std::runtime_error);
+    config.set("cell_size", "0");
+    config.set("grid", "1");
+    EXPECT_THROW(config.resolve(), std::runtime_error);
+}
+
+TEST(CPUSimulationTest, PressureProjectionHandlesStretchedCells) {
+    // cells twice as long in x as in y and z; after the projection a fluid at
+    // rest under gravity should have a divergence-free velocity field
+    const glm::ivec3 dim(9, 17, 17);
+    cpu::ThreadPool pool(2);
+    cpu::Simulation sim(dim, glm::vec3(-1), glm::vec3(1), pool);
+    ASSERT_FLOAT_EQ(sim.cell_size.x, 2 * sim.cell_size.y);
+
+    std::vector<GridCell> grid;
+    for (int z = 0; z < dim.z; ++z) {
+        for (int y = 0; y < dim.y; ++y) {
+            for (int x = 0; x < dim.x; ++x) {
+                const bool fluid = x < dim.x - 1 and y < 8 and z < dim.z - 1;
+                grid.emplace_back(sim.get_world_coord({x, y, z}, {0, 0, 0}), glm::vec3(0), fluid ? GRID_FLUID : GRID_AIR);
+            }
+        }
+    }
+    sim.reset({}, grid);
+    sim.apply_body_forces(0.02);
+    sim.setup_grid_project(0.02);
+    sim.pressure_solve();
+    sim.pressure_update(0.02);
+    sim.setup_grid_project(0.02);
+
+    float max_rhs = 0;
+    for (const GridCell& cell : sim.grid) {
+        if (cell.type == GRID_FLUID)
+            max_rhs = std::max(max_rhs, std::abs(cell.rhs));
+    }
+    EXPECT_LT(max_rhs, 1e-3f);
+}
+
+TEST(CPUSimulationTest, MaxCellSpeedCountsFluidFacesOnly) {
+    const glm::ivec3 dim(5, 5, 9);
+    cpu::ThreadPool pool(1);
+    cpu::Simulation sim(dim, glm::vec3(-1), glm::vec3(1), pool);
+    std::vector<GridCell> grid;
+    for (int i = 0; i < sim.num_cells(); ++i) {
+        grid.emplace_back(sim.get_world_coord(sim.get_grid_coord_from_index(i), {0, 0, 0}), glm::vec3(0), GRID_AIR);
+    }
+    sim.reset({}, grid);
+    const int fluid = sim.get_grid_index({2, 2, 2});
+    sim.grid[fluid].type = GRID_FLUID;
+    sim.grid[fluid].vel = glm::vec3(0.1, 0, 0);
+    sim.grid[sim.get_grid_index({2, 2, 3})].vel.z = -0.5; // upper z face of the fluid cell
+    sim.grid[sim.get_grid_index({0, 0, 0})].vel.x = 100; // far from the fluid
+    EXPECT_FLOAT_EQ(sim.max_cell_speed(), 0.5f / sim.cell_size.z);
+}
+
+TEST(FrameSchedulerTest, TracksRealTimeWithinTheFrameLimit) {
+    FrameScheduler scheduler;
+    scheduler.frame_time = 0.02;
+    scheduler.max_frames = 4;
+    EXPECT_EQ(scheduler.frames_due(1.0), 0); // no elapsed time on the first call
+
+    // rendering at 120 Hz runs a frame every few calls, 30 Hz more than one per call
+    int frames = 0;
+    double t = 1.0;
+    for (int i = 0; i < 120; ++i) {
+        frames += scheduler.frames_due(t += 1.0 / 120);
+    }
+    EXPECT_NEAR(frames, 50, 1);
+    frames = 0;
+    for (int i = 0; i < 30; ++i) {
+        const int due = scheduler.frames_due(t += 1.0 / 30);
+        EXPECT_GE(due, 1);
+        frames += due;
+    }
+    EXPECT_NEAR(frames, 50, 1);
+
+    // a long stall runs max_frames and drops the rest instead of catching up later
+    EXPECT_EQ(scheduler.frames_due(t += 1.0), 4);
+    EXPECT_LT(scheduler.accumulator, scheduler.frame_time);
+    EXPECT_LE(scheduler.frames_due(t += 0.02), 2);
+
+    scheduler.mode = FrameScheduler::Mode::UNCAPPED;
+    EXPECT_EQ(scheduler.frames_due(t), 1);
+    EXPECT_EQ(scheduler.frames_due(t + 10), 1);
+}